@@ -0,0 +1,117 @@
+/*
+ *  Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Roman Kubiak (r.kubiak@samsung.com)
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+
+/**
+ * @file
+ * @author  Roman Kubiak (r.kubiak@samsung.com)
+ * @brief   Asynchronous logging backend
+ */
+
+#ifndef COMMON_LOGGER_BACKEND_ASYNC_HPP
+#define COMMON_LOGGER_BACKEND_ASYNC_HPP
+
+#include "logger/backend.hpp"
+
+#include <sys/time.h>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace logger
+{
+
+	/**
+	 * What to do with a message when the queue is full
+	 */
+	enum class OverflowPolicy
+	{
+		DROP,
+		BLOCK
+	};
+
+	/**
+	 * Asynchronous logging backend, messages are copied to a bounded
+	 * queue of fixed size records and written to the wrapped backend
+	 * by a separate thread. Any number of threads can log at once
+	 * without a lock, longer messages are truncated. The wrapped backend
+	 * is only used by the writer thread, flush() and reopen() are passed
+	 * to it there.
+	 */
+	class AsyncBackend : public LogBackend
+	{
+		public:
+			AsyncBackend(LogBackend *_backend, const size_t capacity, const OverflowPolicy _overflowPolicy = OverflowPolicy::DROP);
+			~AsyncBackend();
+			void log(LogLevel logLevel,
+					 const std::string& file,
+					 const unsigned int& line,
+					 const std::string& func,
+					 const std::string& message) override;
+			bool isThreadSafe() const override;
+			void flush() override;
+			void reopen() override;
+			uint64_t getDropped() const override;
+
+		private:
+			struct Record
+			{
+				std::atomic<size_t> sequence;
+				LogLevel logLevel;
+				unsigned int line;
+				unsigned int threadId;
+				struct timeval time;
+				char file[64];
+				char func[48];
+				char message[360];
+			};
+
+			bool push(LogLevel logLevel,
+					  const std::string& file,
+					  const unsigned int& line,
+					  const std::string& func,
+					  const std::string& message);
+			size_t drain();
+			void writer();
+			void reportDropped();
+			void wakeWriter();
+			static void copyField(char *field, const size_t fieldSize, const std::string& value);
+
+			std::unique_ptr<LogBackend> backend;
+			OverflowPolicy overflowPolicy;
+			std::unique_ptr<Record[]> records;
+			size_t mask;
+			std::atomic<size_t> enqueuePosition;
+			size_t dequeuePosition; /* only the writer thread uses it */
+			std::atomic<uint64_t> dropped;
+			uint64_t droppedReported;
+			std::atomic<bool> stopping;
+			std::atomic<bool> flushRequested;
+			std::atomic<bool> reopenRequested;
+			std::atomic<bool> writerWaiting;
+			std::atomic<unsigned int> producersWaiting;
+			std::mutex waitMutex;
+			std::condition_variable dataAvailable;
+			std::condition_variable spaceAvailable;
+			std::thread writerThread;
+	};
+
+} // namespace logger
+
+#endif // COMMON_LOGGER_BACKEND_ASYNC_HPP
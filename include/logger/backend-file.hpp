@@ -27,20 +27,41 @@
 
 #include "logger/backend.hpp"
 
+#include <chrono>
+
 namespace logger
 {
 
+	/**
+	 * Log file backend, the file stays open and lines are buffered,
+	 * they are written when the buffer fills up, once a second,
+	 * on flush() and right away for errors. With a rotate size the
+	 * file is moved to file.1 (file.1 to file.2 and so on, up to
+	 * rotateCount files are kept) when it grows over that size.
+	 */
 	class FileBackend : public LogBackend
 	{
 		public:
-			FileBackend(const std::string &filePath) : mfilePath(filePath) {}
+			FileBackend(const std::string &filePath, const size_t _rotateSize = 0, const unsigned int _rotateCount = 1);
+			~FileBackend();
 			void log(LogLevel logLevel,
 					 const std::string& file,
 					 const unsigned int& line,
 					 const std::string& func,
 					 const std::string& message) override;
+			void flush() override;
+			void reopen() override;
 		private:
+			void open();
+			void close();
+			void rotate();
 			std::string mfilePath;
+			size_t rotateSize;
+			unsigned int rotateCount;
+			int fileDescriptor;
+			size_t fileSize;
+			std::string buffer;
+			std::chrono::steady_clock::time_point lastFlush;
 	};
 
 } // namespace logger
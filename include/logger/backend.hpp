@@ -27,6 +27,7 @@
 
 #include "logger/level.hpp"
 
+#include <cstdint>
 #include <string>
 
 namespace logger
@@ -43,6 +44,29 @@ namespace logger
 							 const unsigned int& line,
 							 const std::string& func,
 							 const std::string& message) = 0;
+			/**
+			 * Backends that can be used by many threads at once
+			 * are called without the global logger lock
+			 */
+			virtual bool isThreadSafe() const
+			{
+				return false;
+			}
+			/**
+			 * Write out anything the backend buffered
+			 */
+			virtual void flush() {}
+			/**
+			 * Reopen the log (after it was rotated by someone else)
+			 */
+			virtual void reopen() {}
+			/**
+			 * Messages the backend could not write
+			 */
+			virtual uint64_t getDropped() const
+			{
+				return 0;
+			}
 			virtual ~LogBackend() {}
 	};
 
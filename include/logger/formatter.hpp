@@ -27,15 +27,24 @@
 
 #include "logger/level.hpp"
 
+#include <cstddef>
 #include <string>
 
+struct timeval;
+
 namespace logger
 {
 
+	/**
+	 * Enough for any header, unless file and function names are very long
+	 */
+	const size_t LOG_HEADER_LENGTH = 512;
+
 	class LogFormatter
 	{
 		public:
 			static unsigned int getCurrentThread(void);
+			static void setRecordOrigin(const struct timeval *time, const unsigned int threadId);
 			static std::string getCurrentTime(void);
 			static std::string getConsoleColor(LogLevel logLevel);
 			static std::string getDefaultConsoleColor(void);
@@ -45,6 +54,19 @@ namespace logger
 										 const std::string& file,
 										 const unsigned int& line,
 										 const std::string& func);
+			/**
+			 * Same as getHeader() written to the buffer (truncated and
+			 * always terminated), returns it's length. Does not allocate
+			 */
+			static size_t formatHeader(char *buffer,
+									   const size_t size,
+									   LogLevel logLevel,
+									   const std::string& file,
+									   const unsigned int& line,
+									   const std::string& func);
+
+		private:
+			static void formatTime(char *time);
 	};
 
 } // namespace logger
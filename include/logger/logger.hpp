@@ -29,6 +29,8 @@
 #include "logger/backend-file.hpp"
 #include "logger/backend-stderr.hpp"
 
+#include <atomic>
+#include <cstdint>
 #include <sstream>
 #include <string>
 
@@ -36,6 +38,16 @@
 #define PROJECT_SOURCE_DIR ""
 #endif
 
+// every rate limited call site can log this many messages at once,
+// and one more every interval after that
+#ifndef LOG_RATELIMIT_BURST
+#define LOG_RATELIMIT_BURST 5
+#endif
+
+#ifndef LOG_RATELIMIT_INTERVAL_MS
+#define LOG_RATELIMIT_INTERVAL_MS 1000
+#endif
+
 namespace logger
 {
 
@@ -55,6 +67,50 @@ namespace logger
 			static void setLogLevel(const std::string& level);
 			static LogLevel getLogLevel(void);
 			static void setLogBackend(LogBackend* pBackend);
+			static void flush(void);
+			static void reopen(void);
+			static uint64_t getDropped(void);
+	};
+
+	/**
+	 * Token bucket of a single call site, safe to use from many threads
+	 */
+	class RateLimit
+	{
+		public:
+			RateLimit(const unsigned int burst,
+					  const unsigned int intervalMs,
+					  const LogLevel logLevel,
+					  const char* file,
+					  const unsigned int line,
+					  const char* func,
+					  const char* rootDir);
+
+			/**
+			 * @param suppressed how many messages were not allowed since the last allowed one
+			 * @return true if the message can be logged
+			 */
+			bool allow(uint64_t& suppressed);
+
+			/**
+			 * Log how many messages were suppressed at every call site whose
+			 * bucket has refilled, so the count is not lost when the flood stops
+			 */
+			static void flushSuppressed(void);
+
+		private:
+			bool take(const int64_t now);
+
+			const int64_t interval;
+			const int64_t limit;
+			const LogLevel logLevel;
+			const char* const file;
+			const unsigned int line;
+			const char* const func;
+			const char* const rootDir;
+			std::atomic<int64_t> nextArrival;
+			std::atomic<uint64_t> suppressedCount;
+			RateLimit* next;
 	};
 
 } // namespace logger
@@ -73,6 +129,32 @@ namespace logger
         }                                                                  \
     } while (0)
 
+#define LOG_RATELIMITED(SEVERITY, MESSAGE)                                 \
+    do {                                                                   \
+        static logger::RateLimit rateLimit__(LOG_RATELIMIT_BURST,          \
+                                             LOG_RATELIMIT_INTERVAL_MS,    \
+                                             logger::LogLevel::SEVERITY,   \
+                                             __FILE__,                     \
+                                             __LINE__,                     \
+                                             __func__,                     \
+                                             PROJECT_SOURCE_DIR);          \
+        uint64_t suppressed__;                                             \
+        if (logger::Logger::getLogLevel() <= logger::LogLevel::SEVERITY && \
+                rateLimit__.allow(suppressed__)) {                         \
+            std::ostringstream messageStream__;                            \
+            messageStream__ << MESSAGE;                                    \
+            if (suppressed__ > 0)                                          \
+                messageStream__ << " (" << suppressed__                    \
+                                << " similar message(s) suppressed)";      \
+            logger::Logger::logMessage(logger::LogLevel::SEVERITY,         \
+                                       messageStream__.str(),              \
+                                       __FILE__,                           \
+                                       __LINE__,                           \
+                                       __func__,                           \
+                                       PROJECT_SOURCE_DIR);                \
+        }                                                                  \
+    } while (0)
+
 #define LOGE(MESSAGE) LOG(ERROR, MESSAGE)
 #define LOGW(MESSAGE) LOG(WARN, MESSAGE)
 #define LOGI(MESSAGE) LOG(INFO, MESSAGE)
@@ -84,4 +166,9 @@ namespace logger
 #define LOGH(MESSAGE) LOG(HELP, MESSAGE)
 #define LOGT(MESSAGE) LOG(TRACE, MESSAGE)
 
+// for messages that can repeat for every packet
+#define LOGE_RATELIMITED(MESSAGE) LOG_RATELIMITED(ERROR, MESSAGE)
+#define LOGW_RATELIMITED(MESSAGE) LOG_RATELIMITED(WARN, MESSAGE)
+#define LOGI_RATELIMITED(MESSAGE) LOG_RATELIMITED(INFO, MESSAGE)
+
 #endif // COMMON_LOGGER_LOGGER_HPP
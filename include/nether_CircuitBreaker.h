@@ -0,0 +1,76 @@
+/*
+ *  Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Roman Kubiak (r.kubiak@samsung.com)
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+
+/**
+ * @file
+ * @author  Roman Kubiak (r.kubiak@samsung.com)
+ * @brief   Circuit breaker in front of a policy backend
+ */
+
+#ifndef NETHER_CIRCUIT_BREAKER_H
+#define NETHER_CIRCUIT_BREAKER_H
+
+#include "nether_Types.h"
+#include "nether_Metrics.h"
+
+#include <chrono>
+
+enum class NetherCircuitState : std::uint8_t
+{
+	closed,
+	open,
+	halfOpen
+};
+
+/* After failureThreshold failures in a row the circuit opens and no
+	requests go to the backend for openTime, then a single probe request
+	is let through, it's result closes or opens the circuit again.
+	A threshold of 0 keeps the circuit closed */
+class NetherCircuitBreaker
+{
+	public:
+		NetherCircuitBreaker(const std::string &_name, const unsigned int _failureThreshold, const unsigned int _openTimeMs);
+		bool allowRequest();
+		void recordSuccess();
+		void recordFailure();
+		void recordBusy();
+		NetherCircuitState getState() const;
+		const std::string &getName() const;
+		uint64_t getTimesOpened() const;
+		uint64_t getProbes() const;
+		uint64_t getTimesClosed() const;
+		uint64_t getRequestsRejected() const;
+		void setMetrics(NetherCircuitMetrics *metricsToSet);
+		static std::string stateToString(const NetherCircuitState state);
+
+	private:
+		void setState(const NetherCircuitState newState);
+		std::string name;
+		unsigned int failureThreshold;
+		std::chrono::milliseconds openTime;
+		NetherCircuitState state;
+		unsigned int consecutiveFailures;
+		std::chrono::steady_clock::time_point openUntil;
+		uint64_t timesOpened;
+		uint64_t probes;
+		uint64_t timesClosed;
+		uint64_t requestsRejected;
+		NetherCircuitMetrics *metrics;
+};
+
+#endif // NETHER_CIRCUIT_BREAKER_H
@@ -30,18 +30,47 @@
 #include <cynara-client-async.h>
 #include "nether_PolicyBackend.h"
 
+#include <chrono>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
-#include <map>
 
 #ifndef NETHER_CYNARA_INTERNET_PRIVILEGE
 #define NETHER_CYNARA_INTERNET_PRIVILEGE "http://tizen.org/privilege/internet"
 #endif // NETHER_CYNARA_INTERNET_PRIVILEGE
 
+#define NETHER_CYNARA_MAX_PENDING		4096 /* requests waiting for cynara */
+#define NETHER_CYNARA_TIMEOUT			2000 /* ms before the default verdict is used */
+#define NETHER_CYNARA_CHECK_IDS			65536 /* cynara_check_id is 16 bit */
+#define NETHER_CYNARA_NO_SLOT			UINT32_MAX
+#define NETHER_CYNARA_WARMUP_WINDOW		64 /* warm-up checks waiting for cynara at once */
+#define NETHER_CYNARA_WARMUP_ENTRIES	65536 /* uid and security context pairs recorded for the warm-up */
+
 class NetherManager;
 
 const std::string cynaraErrorCodeToString(int cynaraErrorCode);
 typedef std::pair<std::string, int32_t> PrivilegePair;
 
+/* Cynara takes the user as a string, it's formatted on the stack */
+struct NetherCynaraUser
+{
+	explicit NetherCynaraUser(const uid_t uid)
+	{
+		snprintf(text, sizeof(text), "%u", (unsigned int)uid);
+	}
+
+	const char *c_str() const
+	{
+		return (text);
+	}
+
+	char text[NETHER_MAX_USER_LEN];
+};
+
+/* checks are copied around by value, that must never allocate */
+static_assert(std::is_trivially_copyable<NetherPacket>::value, "NetherPacket must be trivially copyable");
+
 struct NetherCynaraCheckInfo
 {
 	NetherCynaraCheckInfo() {}
@@ -55,12 +84,103 @@ struct NetherCynaraCheckInfo
 		packet = other.packet;
 		privilegeId = other.privilegeId;
 		checkId = other.checkId;;
+		answered = other.answered;
 		return *this;
 	}
 
 	NetherPacket packet;
 	u_int32_t privilegeId = -1;
 	cynara_check_id checkId;
+	bool answered = false; /* the cynara server was asked, not only the client cache */
+};
+
+/* What cynara is asked about, checks with the same key get the same answer */
+struct NetherCynaraCheckKey
+{
+	NetherLabelId securityContext;
+	uid_t uid;
+	u_int32_t privilegeId;
+
+	bool operator==(const NetherCynaraCheckKey &other) const
+	{
+		return (securityContext == other.securityContext && uid == other.uid && privilegeId == other.privilegeId);
+	}
+};
+
+struct NetherCynaraCheckKeyHash
+{
+	size_t operator()(const NetherCynaraCheckKey &key) const
+	{
+		return (((size_t)key.securityContext * 2654435761u) ^ ((size_t)key.uid << 8) ^ key.privilegeId);
+	}
+};
+
+struct NetherCynaraPendingCheck
+{
+	NetherCynaraCheckInfo checkInfo;
+	std::vector<u_int32_t> packetIds; /* the packet that started the check and the ones that joined it */
+	std::chrono::steady_clock::time_point deadline;
+	u_int32_t chain; /* with parallel-chain, the chain this check is part of */
+	bool warmup; /* started without a packet, to fill the cynara cache */
+	bool abandoned; /* no verdict is needed anymore, waiting for the cancellation */
+	u_int32_t previous; /* slots waiting for an answer, oldest first */
+	u_int32_t next;
+};
+
+enum class NetherCynaraAnswer : std::uint8_t
+{
+	unknown,
+	allowed,
+	denied
+};
+
+/* With parallel-chain, all privileges of the chain are checked at once
+	for a security context and uid, the packets waiting for it are decided
+	when the first privilege that allows access is known */
+struct NetherCynaraChain
+{
+	NetherCynaraCheckKey key;
+	std::vector<NetherCynaraAnswer> answers;
+	std::vector<u_int32_t> slots; /* pending check of each privilege */
+	std::vector<u_int32_t> packetIds;
+	u_int32_t checksWaiting;
+	bool resolved;
+	bool inUse;
+};
+
+/* Requests waiting for a cynara answer, all slots are allocated up front
+	and reused, a request is found by it's cynara check id or by what it
+	asks about. Since every request gets the same timeout, the slots waiting
+	for an answer are kept in a list ordered by their deadline */
+class NetherCynaraPendingTable
+{
+	public:
+		NetherCynaraPendingTable(const size_t capacity);
+		bool isFull() const;
+		u_int32_t add(const NetherCynaraCheckInfo &checkInfo, const std::chrono::steady_clock::time_point deadline,
+					  const u_int32_t chain = NETHER_CYNARA_NO_SLOT);
+		u_int32_t find(const cynara_check_id checkId) const;
+		u_int32_t findInFlight(const NetherCynaraCheckInfo &checkInfo) const;
+		NetherCynaraPendingCheck &get(const u_int32_t slot);
+		u_int32_t getExpired(const std::chrono::steady_clock::time_point now) const;
+		void abandon(const u_int32_t slot);
+		void release(const u_int32_t slot);
+		size_t getOccupancy() const;
+		size_t getFree() const;
+		size_t getCapacity() const;
+		size_t getHighWatermark() const;
+
+	private:
+		void unlink(const u_int32_t slot);
+		void forget(const u_int32_t slot);
+		static NetherCynaraCheckKey checkKey(const NetherCynaraCheckInfo &checkInfo);
+		std::vector<NetherCynaraPendingCheck> slots;
+		std::vector<u_int32_t> freeSlots;
+		std::vector<u_int32_t> checkIdSlots;
+		std::unordered_map<NetherCynaraCheckKey, u_int32_t, NetherCynaraCheckKeyHash> keySlots;
+		u_int32_t oldest;
+		u_int32_t newest;
+		size_t highWatermark;
 };
 
 class NetherCynaraBackend : public NetherPolicyBackend
@@ -70,28 +190,66 @@ class NetherCynaraBackend : public NetherPolicyBackend
 		~NetherCynaraBackend();
 		bool initialize();
 		bool enqueueVerdict(const NetherPacket &packet);
-		bool reEnqueVerdict(cynara_check_id checkId);
+		bool reEnqueVerdict(NetherCynaraCheckInfo checkInfo);
 		bool cynaraCheck(NetherCynaraCheckInfo checkInfo);
+		bool cynaraCheckChain(const NetherPacket &packet);
 		bool processEvents();
+		unsigned int getTimeoutInterval();
+		void processTimeouts();
+		void logStatistics();
+		uint64_t getPolicyGeneration();
 		int getDescriptor();
 		bool parseInternalPolicy(const std::string &policyFile);
 		NetherDescriptorStatus getDescriptorStatus();
 		void setCynaraDescriptor(const int _currentCynaraDescriptor, const NetherDescriptorStatus _currentCynaraDescriptorStatus);
-		void setCynaraVerdict(cynara_check_id checkId, int cynaraResult);
+		void setCynaraVerdict(const NetherCynaraCheckInfo &checkInfo, int cynaraResult);
 		static void statusCallback(int oldFd, int newFd, cynara_async_status status, void *data);
 		static void checkCallback(cynara_check_id check_id, cynara_async_call_cause cause, int response, void *data);
 
 	private:
 		void parseBackendArgs();
+		bool cancelCheck(const u_int32_t slot);
+		bool loadWarmup(const std::string &path);
+		void saveWarmupRecord();
+		void issueWarmupChecks();
+		void warmupCheckDone();
+		void setChainAnswer(const u_int32_t chainIndex, const u_int32_t privilegeId, const cynara_async_call_cause cause, const int cynaraResult);
+		void tryResolveChain(const u_int32_t chainIndex, const NetherVerdictPath path);
+		void resolveChain(const u_int32_t chainIndex, const NetherVerdict verdict, const int32_t mark, const NetherVerdictPath path);
+		void releaseChain(const u_int32_t chainIndex);
 		void setCacheSize(const size_t newCacheSize);
+		void countCacheResult(const int result);
+		void countPendingChecks();
 		cynara_async *cynaraContext;
 		NetherDescriptorStatus currentCynaraDescriptorStatus;
 		int currentCynaraDescriptor;
 		int cynaraLastResult;
 		cynara_async_configuration *cynaraConfig;
-		std::map<cynara_check_id, NetherCynaraCheckInfo> responseQueue;
+		std::unique_ptr<NetherCynaraPendingTable> pendingChecks;
+		std::vector<NetherCynaraChain> chains;
+		std::vector<u_int32_t> freeChains;
+		std::unordered_map<NetherCynaraCheckKey, u_int32_t, NetherCynaraCheckKeyHash> chainKeys;
 		std::vector<PrivilegePair> privilegeChain;
 		u_int32_t allPrivilegesToCheck;
+		size_t maxPending;
+		unsigned int checkTimeout;
+		bool parallelChain;
+		std::string warmupPath;
+		std::string warmupRecordPath;
+		size_t warmupWindow;
+		std::vector<std::pair<NetherLabelId, uid_t>> warmupEntries;
+		std::unordered_set<uint64_t> seenEntries;
+		size_t warmupNext;
+		size_t warmupInFlight;
+		size_t warmupChecked;
+		size_t warmupLogged;
+		bool warmupRunning;
+		std::chrono::steady_clock::time_point warmupStart;
+		uint64_t checkTimeouts;
+		uint64_t checksRejected;
+		uint64_t checksCreated;
+		uint64_t checksCoalesced;
+		uint64_t checksCancelled;
 };
 
 #endif // HAVE_CYNARA
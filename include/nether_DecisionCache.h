@@ -0,0 +1,104 @@
+/*
+ *  Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Roman Kubiak (r.kubiak@samsung.com)
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+
+/**
+ * @file
+ * @author  Roman Kubiak (r.kubiak@samsung.com)
+ * @brief   Decision cache in front of the policy backends
+ */
+
+#ifndef NETHER_DECISION_CACHE_H
+#define NETHER_DECISION_CACHE_H
+
+#include "nether_Types.h"
+
+#include <chrono>
+#include <list>
+#include <unordered_map>
+
+/* All policy backends decide on the security context, uid and gid
+	of the process, nothing else from the packet */
+struct NetherDecisionKey
+{
+	NetherLabelId securityContext;
+	uid_t uid;
+	gid_t gid;
+
+	bool operator==(const NetherDecisionKey &other) const
+	{
+		return (uid == other.uid && gid == other.gid && securityContext == other.securityContext);
+	}
+};
+
+struct NetherDecisionKeyHash
+{
+	size_t operator()(const NetherDecisionKey &key) const
+	{
+		return (((size_t)key.securityContext * 2654435761u) ^ ((size_t)key.uid << 1) ^ ((size_t)key.gid << 17));
+	}
+};
+
+struct NetherDecision
+{
+	NetherVerdict verdict;
+	int32_t mark;
+};
+
+/* A copy of a cache entry, for saving the cache to disk */
+struct NetherDecisionCacheEntry
+{
+	NetherDecisionKey key;
+	NetherDecision decision;
+	unsigned int secondsLeft;
+};
+
+/* A size limited, least recently used cache of decisions,
+	entries older then the ttl are not used */
+class NetherDecisionCache
+{
+	public:
+		NetherDecisionCache(const size_t _maxEntries, const unsigned int _ttlSeconds);
+		bool lookup(const NetherDecisionKey &key, NetherDecision &decision);
+		void insert(const NetherDecisionKey &key, const NetherDecision &decision);
+		void insert(const NetherDecisionKey &key, const NetherDecision &decision, const unsigned int secondsLeft);
+		void getEntries(std::vector<NetherDecisionCacheEntry> &cacheEntries) const;
+		void clear();
+		size_t getSize() const;
+		uint64_t getHits() const;
+		uint64_t getMisses() const;
+		uint64_t getEvictions() const;
+
+	private:
+		struct CacheEntry
+		{
+			NetherDecisionKey key;
+			NetherDecision decision;
+			std::chrono::steady_clock::time_point expires;
+		};
+		typedef std::list<CacheEntry> CacheList;
+
+		size_t maxEntries;
+		std::chrono::seconds ttl;
+		CacheList entries; /* most recently used first */
+		std::unordered_map<NetherDecisionKey, CacheList::iterator, NetherDecisionKeyHash> index;
+		uint64_t hits;
+		uint64_t misses;
+		uint64_t evictions;
+};
+
+#endif // NETHER_DECISION_CACHE_H
@@ -0,0 +1,77 @@
+/*
+ *  Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Roman Kubiak (r.kubiak@samsung.com)
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+
+/**
+ * @file
+ * @author  Roman Kubiak (r.kubiak@samsung.com)
+ * @brief   On disk snapshot of the decision cache
+ */
+
+#ifndef NETHER_DECISION_SNAPSHOT_H
+#define NETHER_DECISION_SNAPSHOT_H
+
+#include "nether_DecisionCache.h"
+
+#define NETHER_SNAPSHOT_MAGIC			"NTHRSNAP"
+#define NETHER_SNAPSHOT_VERSION			1
+
+/* The file is a header, entryCount records and the labels the records
+	point to. It's only read by nether on the same machine, so it's
+	kept in host byte order */
+struct NetherSnapshotHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t entryCount;
+	uint32_t labelsSize;
+	uint32_t reserved;
+	uint64_t policyGeneration;
+	uint64_t writtenAt; /* wall clock seconds, the ttl keeps running while nether is down */
+	uint64_t checksum; /* of everything after the header */
+};
+
+struct NetherSnapshotRecord
+{
+	uint32_t labelOffset;
+	uint32_t labelLength;
+	uint32_t uid;
+	uint32_t gid;
+	int32_t mark;
+	uint32_t secondsLeft;
+	uint8_t verdict;
+	uint8_t reserved[3];
+};
+
+static_assert(sizeof(NetherSnapshotHeader) == 48, "snapshot header layout changed, bump NETHER_SNAPSHOT_VERSION");
+static_assert(sizeof(NetherSnapshotRecord) == 28, "snapshot record layout changed, bump NETHER_SNAPSHOT_VERSION");
+
+/* Decisions are saved with the generation of the policy that made them,
+	a snapshot of any other generation is not used */
+class NetherDecisionSnapshot
+{
+	public:
+		static bool write(const std::string &path, const uint64_t policyGeneration, const std::vector<NetherDecisionCacheEntry> &entries,
+						  const bool durable);
+		static bool read(const std::string &path, const uint64_t policyGeneration, std::vector<NetherDecisionCacheEntry> &entries);
+
+	private:
+		static bool validate(const uint8_t *data, const size_t size, const uint64_t policyGeneration);
+		static bool writeAll(const int descriptor, const void *data, const size_t size);
+};
+
+#endif // NETHER_DECISION_SNAPSHOT_H
@@ -0,0 +1,77 @@
+/*
+ *  Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Roman Kubiak (r.kubiak@samsung.com)
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+
+/**
+ * @file
+ * @author  Roman Kubiak (r.kubiak@samsung.com)
+ * @brief   epoll based event loop for nether
+ */
+
+#ifndef NETHER_EVENT_LOOP_H
+#define NETHER_EVENT_LOOP_H
+
+#include "nether_Types.h"
+
+#include <functional>
+#include <map>
+#include <sys/epoll.h>
+
+#define NETHER_MAX_EPOLL_EVENTS			16
+
+/* A handler gets the epoll events and the budget (units of work it may
+	do in this iteration), it returns the units of work done or -1
+	if the event loop should stop */
+typedef std::function<int(const uint32_t events, const int budget)> NetherEventHandler;
+typedef std::function<void()> NetherTimerHandler;
+
+struct NetherEventSourceStatistics
+{
+	uint64_t wakeups			= 0;
+	uint64_t unitsHandled		= 0;
+	uint64_t budgetExhausted	= 0;
+};
+
+struct NetherEventSource
+{
+	int budget;
+	NetherEventSourceStatistics *statistics;
+	NetherEventHandler handler;
+};
+
+class NetherEventLoop
+{
+	public:
+		NetherEventLoop();
+		~NetherEventLoop();
+		bool initialize();
+		bool addDescriptor(const int descriptor, const uint32_t events, const std::string &name, const int budget, NetherEventHandler handler);
+		bool modifyDescriptor(const int descriptor, const uint32_t events);
+		bool removeDescriptor(const int descriptor);
+		int addTimer(const std::string &name, const unsigned int intervalMs, NetherTimerHandler handler);
+		bool dispatch(const int timeoutMs = -1);
+		const std::map<std::string, NetherEventSourceStatistics> &getStatistics() const;
+
+	private:
+		int epollDescriptor;
+		std::map<int, NetherEventSource> eventSources;
+		std::map<std::string, NetherEventSourceStatistics> eventStatistics;
+		std::vector<int> timerDescriptors;
+		struct epoll_event readyEvents[NETHER_MAX_EPOLL_EVENTS];
+};
+
+#endif // NETHER_EVENT_LOOP_H
@@ -30,10 +30,12 @@
 #include <string>
 #include <vector>
 #include <tuple>
+#include <unordered_map>
 
 #include "nether_PolicyBackend.h"
 
 #define NETHER_POLICY_CREDS_DELIM   ":"
+#define NETHER_POLICY_INDEX_TIERS	4 /* uid and/or gid can be a wildcard */
 
 class NetherManager;
 
@@ -53,6 +55,14 @@ struct PolicyEntry
 	NetherVerdict verdict;
 };
 
+/* The policy entries that have the same fields set (not wildcards),
+	each tier maps those uid and gid values to the position of the first
+	entry in the policy file that has them */
+struct PolicyIndex
+{
+	std::unordered_map<uint64_t, size_t> tiers[NETHER_POLICY_INDEX_TIERS];
+};
+
 const std::string dumpPolicyEntry(const PolicyEntry &entry);
 
 class NetherFileBackend : public NetherPolicyBackend
@@ -65,9 +75,16 @@ class NetherFileBackend : public NetherPolicyBackend
 		bool enqueueVerdict(const NetherPacket &packet);
 		bool parsePolicyFile(std::ifstream &policyFile);
 		bool processEvents() { return (true); }
+		uint64_t getPolicyGeneration();
 		std::vector<std::string> split(const std::string  &str, const std::string  &delim);
 	private:
+		void buildPolicyIndex();
+		void lookupPolicyIndex(const PolicyIndex &index, const NetherPacket &packet, size_t &firstMatch) const;
+		static size_t policyIndexTier(const bool uidWildcard, const bool gidWildcard);
+		static uint64_t policyIndexKey(const uid_t uid, const gid_t gid);
 		std::vector<PolicyEntry> policy;
+		std::unordered_map<NetherLabelId, PolicyIndex> contextIndex;
+		PolicyIndex anyContextIndex;
 };
 
 #endif
@@ -0,0 +1,72 @@
+/*
+ *  Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Roman Kubiak (r.kubiak@samsung.com)
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+
+/**
+ * @file
+ * @author  Roman Kubiak (r.kubiak@samsung.com)
+ * @brief   Kernel side statistics of the netfilter queues
+ */
+
+#ifndef NETHER_KERNEL_QUEUE_H
+#define NETHER_KERNEL_QUEUE_H
+
+#include "nether_Types.h"
+
+#include <functional>
+
+#define NETHER_KERNEL_QUEUE_PATH		"/proc/net/netfilter/nfnetlink_queue"
+
+/* One line of NETHER_KERNEL_QUEUE_PATH */
+struct NetherKernelQueueStatus
+{
+	uint32_t queueNumber;
+	uint32_t portId;		/* of the netlink socket bound to the queue */
+	uint32_t pending;		/* packets waiting for a verdict */
+	uint32_t copyMode;
+	uint32_t copyRange;
+	uint32_t queueDropped;	/* the queue was full (queue maxlen) */
+	uint32_t userDropped;	/* the netlink socket buffer was full */
+	uint32_t idSequence;	/* id of the last packet queued */
+	bool seen;				/* false until the queue shows up in the file */
+	bool overThreshold;
+};
+
+/* Called when the pending packets of a queue go over the warning
+	threshold, and again when they go back under it */
+typedef std::function<void(const NetherKernelQueueStatus &status)> NetherQueueDepthHandler;
+
+class NetherKernelQueue
+{
+	public:
+		NetherKernelQueue(const std::vector<int> &queueNumbers, const uint32_t _depthWarning,
+						  const std::string &_path = NETHER_KERNEL_QUEUE_PATH);
+		void setDepthHandler(NetherQueueDepthHandler handler);
+		bool collect();
+		const std::vector<NetherKernelQueueStatus> &getStatus() const;
+		static bool parse(const std::string &line, NetherKernelQueueStatus &status);
+
+	private:
+		void update(NetherKernelQueueStatus &status, const NetherKernelQueueStatus &newStatus);
+		std::vector<NetherKernelQueueStatus> queues;
+		NetherQueueDepthHandler depthHandler;
+		uint32_t depthWarning;
+		std::string path;
+		bool readFailed;
+};
+
+#endif // NETHER_KERNEL_QUEUE_H
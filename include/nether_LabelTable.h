@@ -0,0 +1,72 @@
+/*
+ *  Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Roman Kubiak (r.kubiak@samsung.com)
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+
+/**
+ * @file
+ * @author  Roman Kubiak (r.kubiak@samsung.com)
+ * @brief   Security context (label) intern table
+ */
+
+#ifndef NETHER_LABEL_TABLE_H
+#define NETHER_LABEL_TABLE_H
+
+#include "nether_Types.h"
+
+#include <deque>
+#include <mutex>
+
+#define NETHER_LABEL_TABLE_SLOTS		1024 /* initial size, always a power of 2 */
+#define NETHER_LABEL_CACHE_SLOTS		256 /* labels each thread finds without the lock, a power of 2 */
+
+/* Every distinct security context gets a small integer id, packets
+	carry only that id. Labels are never removed, the number of distinct
+	labels on a system is small. The table is shared by all queue threads,
+	each thread remembers the labels it has seen, so only a label that is
+	new to a thread takes the lock */
+class NetherLabelTable
+{
+	public:
+		static NetherLabelId intern(const char *label, const size_t length);
+		static NetherLabelId intern(const std::string &label);
+		static const std::string &toString(const NetherLabelId labelId);
+		static size_t getSize();
+
+	private:
+		/* a label string never changes or moves once it's in the table */
+		struct NetherLabelCacheEntry
+		{
+			const std::string *label;
+			uint32_t hash;
+			NetherLabelId labelId;
+		};
+
+		NetherLabelTable();
+		static NetherLabelTable &instance();
+		static uint32_t hashLabel(const char *label, const size_t length);
+		NetherLabelId find(const char *label, const size_t length, const uint32_t hash);
+		NetherLabelId insert(const char *label, const size_t length, const uint32_t hash);
+		void grow();
+		std::mutex tableMutex;
+		std::deque<std::string> labels; /* references stay valid when it grows */
+		std::vector<uint32_t> labelHashes;
+		std::vector<NetherLabelId> slots; /* open addressing, NETHER_NO_LABEL is a free slot */
+		static thread_local NetherLabelCacheEntry internCache[NETHER_LABEL_CACHE_SLOTS];
+		static thread_local std::vector<const std::string *> labelCache; /* by id */
+};
+
+#endif // NETHER_LABEL_TABLE_H
@@ -0,0 +1,159 @@
+/*
+ *  Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Roman Kubiak (r.kubiak@samsung.com)
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+
+/**
+ * @file
+ * @author  Roman Kubiak (r.kubiak@samsung.com)
+ * @brief   Packet to verdict latency histograms
+ */
+
+#ifndef NETHER_LATENCY_HISTOGRAM_H
+#define NETHER_LATENCY_HISTOGRAM_H
+
+#include "nether_Types.h"
+
+#include <atomic>
+
+#define NETHER_HISTOGRAM_SUB_BITS		3 /* 8 linear buckets between two powers of two, at most 12.5% off */
+#define NETHER_HISTOGRAM_SUB_BUCKETS	(1 << NETHER_HISTOGRAM_SUB_BITS)
+#define NETHER_HISTOGRAM_BUCKETS		((64 - NETHER_HISTOGRAM_SUB_BITS + 1) * NETHER_HISTOGRAM_SUB_BUCKETS)
+#define NETHER_LATENCY_RING_SIZE		8192 /* packets that can wait for a verdict and still be measured, a power of two */
+#define NETHER_LATENCY_SOURCES			5
+#define NETHER_LATENCY_VERDICTS			3 /* noVerdictYet is never measured */
+
+/* Who decided about a packet, the backends are told apart by what
+	they cost: a Cynara cache hit is cheap, a Cynara round trip is not */
+enum class NetherLatencySource : std::uint8_t
+{
+	decisionCache,
+	cynaraCache,
+	cynara,
+	file,
+	fallback
+};
+
+/* Log-linear histogram of nanoseconds, the buckets double in width with
+	every power of two and each power of two is split in linear buckets.
+	One thread records, any thread can read */
+class NetherLatencyHistogram
+{
+	public:
+		NetherLatencyHistogram();
+		void add(const NetherLatencyHistogram &other);
+		uint64_t getCount() const;
+		uint64_t getSum() const;
+		uint64_t getMean() const;
+		uint64_t getPercentile(const double percentile) const;
+		std::string toString() const;
+		static uint64_t getBucketLimit(const uint32_t bucket);
+
+		void record(const uint64_t nanoseconds)
+		{
+			const uint32_t bucket = getBucket(nanoseconds);
+
+			/* there is only one writer, no need for a locked increment */
+			buckets[bucket].store(buckets[bucket].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			sum.store(sum.load(std::memory_order_relaxed) + nanoseconds, std::memory_order_relaxed);
+		}
+
+		static uint32_t getBucket(const uint64_t nanoseconds)
+		{
+			if(nanoseconds < NETHER_HISTOGRAM_SUB_BUCKETS)
+				return (nanoseconds);
+
+			const uint32_t exponent	= 63 - __builtin_clzll(nanoseconds);
+			const uint32_t shift	= exponent - NETHER_HISTOGRAM_SUB_BITS;
+
+			return ((shift + 1) * NETHER_HISTOGRAM_SUB_BUCKETS + ((nanoseconds >> shift) & (NETHER_HISTOGRAM_SUB_BUCKETS - 1)));
+		}
+
+	private:
+		std::atomic<uint64_t> buckets[NETHER_HISTOGRAM_BUCKETS];
+		std::atomic<uint64_t> count;
+		std::atomic<uint64_t> sum;
+};
+
+/* Packet ids of a queue go up by one, so the receive time of a packet
+	is kept in a ring indexed by it's id until the verdict is cast */
+class NetherPacketLatency
+{
+	public:
+		NetherPacketLatency();
+		static NetherLatencySource getSource(const NetherPolicyBackendType backendType);
+		static std::string sourceToString(const NetherLatencySource source);
+		const NetherLatencyHistogram &getHistogram(const NetherLatencySource source, const NetherVerdict verdict) const;
+		void getTotal(NetherLatencyHistogram &total) const;
+		uint64_t getUntracked() const;
+
+		void packetReceived(const u_int32_t packetId, const uint64_t receivedAt, const NetherLatencySource source)
+		{
+			NetherLatencySlot &slot = ring[packetId & (NETHER_LATENCY_RING_SIZE - 1)];
+
+			slot.packetId	= packetId;
+			slot.receivedAt	= receivedAt;
+			slot.source		= source;
+			slot.waiting	= true;
+		}
+
+		/* the packet went on to another backend */
+		void setSource(const u_int32_t packetId, const NetherLatencySource source)
+		{
+			NetherLatencySlot &slot = ring[packetId & (NETHER_LATENCY_RING_SIZE - 1)];
+
+			if(slot.waiting && slot.packetId == packetId)
+				slot.source = source;
+		}
+
+		void packetDecided(const u_int32_t packetId, const NetherVerdict verdict, const NetherVerdictPath path, const uint64_t decidedAt)
+		{
+			NetherLatencySlot &slot = ring[packetId & (NETHER_LATENCY_RING_SIZE - 1)];
+			NetherLatencySource source = slot.source;
+
+			/* the slot was taken by a packet received later */
+			if(!slot.waiting || slot.packetId != packetId || verdict >= NetherVerdict::noVerdictYet)
+			{
+				untracked.store(untracked.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+				return;
+			}
+
+			slot.waiting = false;
+
+			if(path == NetherVerdictPath::fallback)
+				source = NetherLatencySource::fallback;
+			else if(path == NetherVerdictPath::cached && source == NetherLatencySource::cynara)
+				source = NetherLatencySource::cynaraCache;
+
+			histograms[(size_t)source][(size_t)verdict].record(decidedAt > slot.receivedAt ? decidedAt - slot.receivedAt : 0);
+		}
+
+	private:
+		struct NetherLatencySlot
+		{
+			uint64_t receivedAt;
+			u_int32_t packetId;
+			NetherLatencySource source;
+			bool waiting;
+		};
+
+		std::vector<NetherLatencySlot> ring;
+		NetherLatencyHistogram histograms[NETHER_LATENCY_SOURCES][NETHER_LATENCY_VERDICTS];
+		std::atomic<uint64_t> untracked;
+};
+
+#endif // NETHER_LATENCY_HISTOGRAM_H
@@ -28,34 +28,114 @@
 #include "nether_Types.h"
 #include "nether_DummyBackend.h"
 #include "nether_Netlink.h"
+#include "nether_EventLoop.h"
+#include "nether_DecisionCache.h"
+#include "nether_CircuitBreaker.h"
+#include "nether_LatencyHistogram.h"
+#include "nether_Metrics.h"
+#include "nether_KernelQueue.h"
 
+#include <atomic>
+#include <deque>
+#include <thread>
 
-class NetherManager : public NetherVerdictListener, public NetherProcessedPacketListener
+#define NETHER_CONTROL_RELOAD			0x1
+#define NETHER_CONTROL_STATISTICS		0x2
+#define NETHER_CONTROL_STOP				0x4
+#define NETHER_HEDGE_LATE_VERDICT_WAIT	60 /* seconds to wait for the losing answer of a hedged packet */
+#define NETHER_PENDING_RING_SIZE		65536 /* packets the manager follows until their verdict, a power of two */
+
+/* A packet the primary backend has not answered yet, after the hedge
+	delay it's also given to the backup backend, the first answer wins */
+struct NetherInFlightPacket
+{
+	NetherPacket packet;
+	bool hedged;
+	bool decided;
+	bool inUse;
+};
+
+/* What a packet sent to the primary backend asked, so the answer can be cached */
+struct NetherPendingDecision
+{
+	u_int32_t packetId;
+	bool inUse;
+	NetherDecisionKey key;
+};
+
+typedef std::deque<std::pair<u_int32_t, std::chrono::steady_clock::time_point>> NetherPacketDeadlines;
+
+class NetherManager : public NetherVerdictListener, public NetherProcessedPacketListener, public NetherDescriptorListener
 {
 	public:
-		NetherManager(const NetherConfig &_netherConfig);
+		NetherManager(const NetherConfig &_netherConfig, const bool _queueWorker = false);
 		~NetherManager();
 		bool initialize();
 		bool process();
 		NetherConfig &getConfig();
+		uint64_t getPacketsReceived() const;
+		const NetherMetrics &getMetrics() const;
+		const NetherPacketLatency *getPacketLatency() const;
+		void requestControl(const uint32_t request);
 		static NetherPolicyBackend *getPolicyBackend(const NetherConfig &netherConfig, const bool primary = true);
-		bool verdictCast(const u_int32_t packetId, const NetherVerdict verdict, int mark);
+		bool verdictCast(const u_int32_t packetId, const NetherVerdict verdict, int mark, const NetherVerdictPath path);
 		void packetReceived(const NetherPacket &packet);
+		void descriptorChanged(const int oldDescriptor, const int newDescriptor, const NetherDescriptorStatus status);
 		bool restoreRules();
 
 	private:
 		static bool isCommandAvailable(const std::string &command);
-		void handleSignal();
-		bool handleNetlinkpacket();
-		void setupSelectSockets(fd_set &watchedReadDescriptorsSet, fd_set &watchedWriteDescriptorsSet, struct timeval &timeoutSpecification);
+		bool initializeQueue();
+		bool initializeMetrics();
+		bool initializeKernelQueue();
+		void queueDepthChanged(const NetherKernelQueueStatus &status);
+		void startQueueWorkers();
+		int handleControl();
+		int handleSignal();
+		void reload();
+		void logStatistics();
+		void logLatency();
+		uint64_t getPolicyGeneration();
+		void loadDecisionSnapshot();
+		void saveDecisionSnapshot(const bool durable);
+		void hedgeSlowPackets();
+		bool enqueueBackupVerdict(const NetherPacket &packet);
+		int handleNetlinkpacket(const int budget);
+		int handleBackendEvents(const int budget);
+		NetherPendingDecision *findPendingDecision(const u_int32_t packetId);
+		NetherInFlightPacket *findInFlightPacket(const u_int32_t packetId);
+		void releaseInFlightPacket(NetherInFlightPacket &inFlight);
+		static uint32_t descriptorStatusToEvents(const NetherDescriptorStatus status);
 		std::unique_ptr <NetherPolicyBackend> netherPrimaryPolicyBackend;
 		std::unique_ptr <NetherPolicyBackend> netherBackupPolicyBackend;
 		std::unique_ptr <NetherPolicyBackend> netherFallbackPolicyBackend;
 		std::unique_ptr <NetherNetlink> netherNetlink;
+		std::unique_ptr <NetherEventLoop> netherEventLoop;
+		std::unique_ptr <NetherDecisionCache> decisionCache;
+		std::unique_ptr <NetherPacketLatency> packetLatency;
+		/* indexed by the packet id, a packet still waiting when a newer
+			one takes it's slot is just not followed anymore */
+		std::vector<NetherPendingDecision> pendingDecisions;
+		std::vector<NetherInFlightPacket> inFlightPackets;
+		size_t inFlightCount;
+		NetherPacketDeadlines hedgeDeadlines; /* the delay is fixed, so these are in order */
+		NetherPacketDeadlines lateVerdictDeadlines;
+		NetherCircuitBreaker primaryBreaker;
+		NetherCircuitBreaker backupBreaker;
 		NetherConfig netherConfig;
 		int netlinkDescriptor;
 		int backendDescriptor;
 		int signalDescriptor;
+		int controlDescriptor;
+		int workerExitDescriptor;
+		bool queueWorker;
+		bool stopRequested;
+		std::atomic<uint32_t> controlRequests;
+		NetherMetrics metrics;
+		std::unique_ptr <NetherMetricsServer> metricsServer;
+		std::unique_ptr <NetherKernelQueue> kernelQueue;
+		std::vector<std::unique_ptr<NetherManager>> queueWorkers;
+		std::vector<std::thread> workerThreads;
 #ifdef HAVE_AUDIT
 		int auditDescriptor;
 #endif // HAVE_AUDIT
@@ -0,0 +1,170 @@
+/*
+ *  Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Roman Kubiak (r.kubiak@samsung.com)
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+
+/**
+ * @file
+ * @author  Roman Kubiak (r.kubiak@samsung.com)
+ * @brief   Metrics of the queue threads and the socket they are read from
+ */
+
+#ifndef NETHER_METRICS_H
+#define NETHER_METRICS_H
+
+#include "nether_Types.h"
+#include "nether_LatencyHistogram.h"
+#include "nether_KernelQueue.h"
+
+#include <atomic>
+
+#define NETHER_METRICS_MARKS			16 /* different marks counted for each verdict, the rest are counted together */
+#define NETHER_METRICS_CLIENTS			8 /* connections waiting to be accepted */
+
+/* A counter written by one thread only, so it's not incremented with
+	a locked instruction, any thread can read it */
+class NetherCounter
+{
+	public:
+		NetherCounter() : value(0) {}
+
+		void add(const uint64_t amount = 1)
+		{
+			value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+		}
+
+		void set(const uint64_t newValue)
+		{
+			value.store(newValue, std::memory_order_relaxed);
+		}
+
+		uint64_t get() const
+		{
+			return (value.load(std::memory_order_relaxed));
+		}
+
+	private:
+		std::atomic<uint64_t> value;
+};
+
+/* Verdicts by the mark they were sent with, the marks come from
+	the policy, so the first NETHER_METRICS_MARKS ones seen get a counter */
+class NetherVerdictCounters
+{
+	public:
+		NetherVerdictCounters();
+		uint32_t getMarks(const NetherVerdict verdict) const;
+		int32_t getMark(const NetherVerdict verdict, const uint32_t index) const;
+		uint64_t getCount(const NetherVerdict verdict, const uint32_t index) const;
+		uint64_t getOtherMarks(const NetherVerdict verdict) const;
+
+		void add(const NetherVerdict verdict, const int32_t mark)
+		{
+			const size_t verdictIndex	= (size_t)verdict;
+			const uint32_t marksUsed	= used[verdictIndex].load(std::memory_order_relaxed);
+
+			for(uint32_t index = 0; index < marksUsed; index++)
+			{
+				if(marks[verdictIndex][index] == mark)
+				{
+					counts[verdictIndex][index].add();
+					return;
+				}
+			}
+
+			if(marksUsed == NETHER_METRICS_MARKS)
+			{
+				otherMarks[verdictIndex].add();
+				return;
+			}
+
+			/* readers only look at a mark after it's published */
+			marks[verdictIndex][marksUsed] = mark;
+			counts[verdictIndex][marksUsed].add();
+			used[verdictIndex].store(marksUsed + 1, std::memory_order_release);
+		}
+
+	private:
+		int32_t marks[NETHER_LATENCY_VERDICTS][NETHER_METRICS_MARKS];
+		NetherCounter counts[NETHER_LATENCY_VERDICTS][NETHER_METRICS_MARKS];
+		NetherCounter otherMarks[NETHER_LATENCY_VERDICTS];
+		std::atomic<uint32_t> used[NETHER_LATENCY_VERDICTS];
+};
+
+/* What the circuit breaker of a policy backend did */
+struct NetherCircuitMetrics
+{
+	NetherCounter opened;
+	NetherCounter probes;
+	NetherCounter closed;
+	NetherCounter state; /* the current NetherCircuitState */
+};
+
+/* Each queue thread has it's own metrics, they are added up when read */
+struct NetherMetrics
+{
+	NetherCounter packetsReceived;
+	NetherVerdictCounters verdicts;
+	NetherCounter receiveBuffersFull; /* ENOBUFS, the kernel dropped packets */
+	NetherCounter decisionCacheHits;
+	NetherCounter decisionCacheMisses;
+	NetherCounter backupFallbacks;
+	NetherCounter dummyFallbacks;
+	NetherCounter primaryDiverted; /* by the circuit breaker */
+	NetherCounter backupDiverted;
+	NetherCircuitMetrics primaryCircuit;
+	NetherCircuitMetrics backupCircuit;
+	NetherCounter verdictsInTime;
+	NetherCounter packetsHedged;
+	NetherCounter lateVerdictsDropped;
+	NetherCounter cynaraCacheHits;
+	NetherCounter cynaraCacheMisses;
+	NetherCounter cynaraPendingChecks;
+	NetherCounter reloads;
+	NetherCounter queueDepthWarnings;
+};
+
+/* Serves the metrics in the Prometheus text format on a unix socket,
+	every client that connects gets them once and is disconnected */
+class NetherMetricsServer
+{
+	public:
+		NetherMetricsServer(const std::string &_socketPath);
+		~NetherMetricsServer();
+		bool initialize();
+		int getDescriptor() const;
+		void addShard(const int queueNumber, const NetherMetrics *metrics, const NetherPacketLatency *packetLatency = nullptr);
+		void setKernelQueue(const NetherKernelQueue *_kernelQueue); /* read in the same thread */
+		int handleClients(const int budget);
+		std::string getText() const;
+
+	private:
+		struct NetherMetricsShard
+		{
+			int queueNumber; /* -1 for a thread that does not handle a queue */
+			const NetherMetrics *metrics;
+			const NetherPacketLatency *packetLatency;
+		};
+
+		uint64_t sum(NetherCounter NetherMetrics::*counter) const;
+		uint64_t sum(NetherCircuitMetrics NetherMetrics::*circuit, NetherCounter NetherCircuitMetrics::*counter) const;
+		std::string socketPath;
+		std::vector<NetherMetricsShard> shards;
+		const NetherKernelQueue *kernelQueue;
+		int listenDescriptor;
+};
+
+#endif // NETHER_METRICS_H
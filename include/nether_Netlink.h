@@ -27,9 +27,24 @@
 
 #include "nether_Types.h"
 #include "nether_Utils.h"
+#include "nether_Metrics.h"
+
+
+#define NETHER_VERDICT_BUFFER_SIZE		65536
+#define NETHER_VERDICT_MESSAGE_SIZE		64 /* nlmsghdr, nfgenmsg, verdict header, mark and conntrack mark, aligned */
+#define NETHER_CTA_MARK					8 /* CTA_MARK from linux/netfilter/nfnetlink_conntrack.h */
+#define NETHER_UNDECIDED_WINDOW			(1 << 20) /* packets a verdict is waited for with batched verdicts, a power of 2 */
+#define NETHER_NETLINK_BUFFER_GROWTH	4 /* ENOBUFS grows the receive buffer up to this many times it's configured size */
 
 class NetherManager;
 
+struct NetherVerdictEntry
+{
+	u_int32_t packetId;
+	u_int32_t verdict;
+	int32_t mark;		/* -1 means don't touch the packet mark */
+};
+
 class NetherNetlink : public NetherPacketProcessor
 {
 	public:
@@ -38,20 +53,55 @@ class NetherNetlink : public NetherPacketProcessor
 		bool initialize();
 		bool reload();
 		static int callback(struct nfq_q_handle *qh, struct nfgenmsg *nfmsg, struct nfq_data *nfa, void *data);
-		bool processPacket(char *packetBuffer, const int packetReadSize);
+		bool processPacket(char *packetBuffer, const int packetReadSize, const uint64_t receivedAt);
+		int receivePackets(const int budget);
+		void receiveBufferFull();
+		void packetTruncated(const char *packetBuffer, const int packetReadSize);
 		void setVerdict(const u_int32_t packetId, const NetherVerdict verdict, int32_t mark = -1);
+		void flushVerdicts();
+		uint64_t getVerdictsIssued() const;
+		uint64_t getVerdictSyscalls() const;
+		uint64_t getVerdictSyscallsSaved() const;
 		int getDescriptor();
 		const NetherConfig &getNetherConfig();
 		void getInterfaceInfo(struct nfq_data *nfa, NetherPacket &netherPacket);
+		void setMetrics(NetherMetrics *metricsToSet);
+		static size_t getBatchEnd(const std::vector<NetherVerdictEntry> &entries, const size_t entry, size_t runEnd,
+								  const bool haveUndecided, const u_int32_t lowestUndecided);
 
 	protected:
 		NetherPacket *processedPacket;
 
 	private:
+		bool setReceiveBuffer(const int size);
+		void destroyQueue();
+		void packetUndecided(const u_int32_t packetId);
+		void packetDecided(const u_int32_t packetId);
+		bool getLowestUndecided(u_int32_t &packetId);
+		bool getVerdictEntry(const u_int32_t packetId, const NetherVerdict verdict, int32_t mark, NetherVerdictEntry &entry);
+		void issueVerdict(const NetherVerdictEntry &entry);
+		void appendVerdictMessage(const NetherVerdictEntry &entry, const bool batch);
+		void sendVerdictMessages(const size_t firstEntry, const size_t lastEntry);
 		struct nfq_q_handle *queueHandle;
 		struct nfq_handle *nfqHandle;
 		struct nlif_handle *nlif;
 		uint32_t queue;
+		uint64_t packetReceivedAt;
+		int receiveBufferSize;
+		size_t receiveMessageSize;
+		NetherMetrics *metrics;
+		std::vector<char> receiveBuffers;
+		std::vector<struct iovec> receiveVectors;
+		std::vector<struct mmsghdr> receiveMessages;
+		std::vector<NetherVerdictEntry> pendingVerdicts;
+		std::vector<uint64_t> undecidedPackets; /* a bit for every packet id in the window */
+		u_int32_t undecidedOldest; /* all packets before it are decided */
+		u_int32_t undecidedNext; /* after the newest packet */
+		std::vector<char> verdictBuffer;
+		size_t verdictBufferLength;
+		u_int32_t verdictSequence;
+		uint64_t verdictsIssued;
+		uint64_t verdictSyscalls;
 };
 
 #endif  // NETLINK_H_INCLUDED
@@ -27,11 +27,12 @@
 
 #include "nether_Types.h"
 #include "nether_Utils.h"
+#include "nether_Metrics.h"
 
 class NetherPolicyBackend : public NetherVerdictCaster
 {
 	public:
-		NetherPolicyBackend(const NetherConfig &_netherConfig) : netherConfig(_netherConfig) {}
+		NetherPolicyBackend(const NetherConfig &_netherConfig) : netherConfig(_netherConfig), descriptorListener(nullptr), metrics(nullptr), overloaded(false) {}
 		virtual ~NetherPolicyBackend() {}
 		virtual bool enqueueVerdict(const NetherPacket &packet) = 0;
 		virtual bool initialize() = 0;
@@ -48,9 +49,46 @@ class NetherPolicyBackend : public NetherVerdictCaster
 			return (NetherDescriptorStatus::unknownStatus);
 		}
 		virtual bool processEvents() = 0;
+		/* Backends with requests that can time out return how often
+			(in milliseconds) processTimeouts() needs to be called */
+		virtual unsigned int getTimeoutInterval()
+		{
+			return (0);
+		}
+		virtual void processTimeouts() {}
+		virtual void logStatistics() {}
+		/* Changes whenever the policy the backend loaded changes,
+			backends that decide only on the configuration return 0 */
+		virtual uint64_t getPolicyGeneration()
+		{
+			return (0);
+		}
+		/* The last enqueueVerdict() failed only because too many requests
+			were waiting already, the backend itself works */
+		bool isOverloaded() const
+		{
+			return (overloaded);
+		}
+		void setDescriptorListener(NetherDescriptorListener *listenerToSet)
+		{
+			descriptorListener = listenerToSet;
+		}
+		void setMetrics(NetherMetrics *metricsToSet)
+		{
+			metrics = metricsToSet;
+		}
 
 	protected:
+		void notifyDescriptorChanged(const int oldDescriptor, const int newDescriptor, const NetherDescriptorStatus status)
+		{
+			if(descriptorListener)
+				descriptorListener->descriptorChanged(oldDescriptor, newDescriptor, status);
+		}
+
 		NetherConfig netherConfig;
+		NetherDescriptorListener *descriptorListener;
+		NetherMetrics *metrics; /* of the thread the backend runs in */
+		bool overloaded;
 };
 
 #endif
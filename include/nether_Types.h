@@ -92,14 +92,41 @@
 
 #define NETHER_DEFAULT_VERDICT			NetherVerdict::allowAndLog
 #define NETHER_PACKET_BUFFER_SIZE		4096
+#define NETHER_IPV4_HEADER_SIZE			20 /* up to 60 with options */
+#define NETHER_IPV6_HEADER_SIZE			40
+#define NETHER_IPV6_EXTENSIONS_SIZE		88 /* extension headers that fit in the copy range */
+#define NETHER_PORTS_SIZE				4 /* all the decoders read of TCP/UDP */
+#define NETHER_COPY_RANGE				(NETHER_IPV6_HEADER_SIZE + NETHER_IPV6_EXTENSIONS_SIZE + NETHER_PORTS_SIZE)
+#define NETHER_RECEIVE_MESSAGE_OVERHEAD	512 /* netlink headers and queue attributes, without the security context and conntrack */
+#define NETHER_RECEIVE_BATCH_MAX		4096
+#define NETHER_NETLINK_BUDGET			256
+#define NETHER_BACKEND_BUDGET			16
+#define NETHER_STATISTICS_INTERVAL		0
+#define NETHER_DECISION_CACHE_SIZE		0
+#define NETHER_DECISION_CACHE_TTL		60
+#define NETHER_DECISION_SNAPSHOT_INTERVAL	60
+#define NETHER_HEDGE_DELAY				0
+#define NETHER_BREAKER_THRESHOLD		5
+#define NETHER_BREAKER_OPEN_TIME		1000
+#define NETHER_LOG_QUEUE_SIZE			0
+#define NETHER_LOG_ROTATE_SIZE			0
+#define NETHER_LOG_ROTATE_COUNT			5
+#define NETHER_KERNEL_QUEUE_INTERVAL	1000
+#define NETHER_QUEUE_DEPTH_WARNING		512
+#define NETHER_QUEUE_MAXLEN				0 /* keep the kernel default (1024) */
+#define NETHER_NETLINK_BUFFER_SIZE		0 /* keep the kernel default (net.core.rmem_default) */
+#define NETHER_NETLINK_BUFFER_MAX		(256 * 1024 * 1024)
+#define NETHER_FINGERPRINT_SEED			14695981039346656037ULL
 #define NETHER_INVALID_UID				(uid_t) -1
 #define NETHER_INVALID_GID				(gid_t) -1
+#define NETHER_NO_LABEL					0
 #define NETHER_NETWORK_ADDR_LEN			16 /* enough to hold ipv4 and ipv6 */
 #define NETHER_NETWORK_IPV4_ADDR_LEN	4
 #define NETHER_NETWORK_IPV6_ADDR_LEN	16
 #define NETHER_MAX_USER_LEN				32
 #define NETLINK_DROP_MARK				3
 #define NETLINK_ALLOWLOG_MARK			4
+#define NETLINK_ALLOW_MARK				1
 #define NETLINK_QUEUE_NUM				0
 #define NETHER_LOG_BACKEND				NetherLogBackendType::stderrBackend
 #define NETHER_IPTABLES_RESTORE_PATH	"/usr/sbin/iptables-restore"
@@ -128,6 +155,15 @@ enum class NetherVerdict : std::uint8_t
 	noVerdictYet
 };
 
+/* How a verdict was reached, a fallback verdict is not a decision
+	of the policy (the backend timed out or could not answer) */
+enum class NetherVerdictPath : std::uint8_t
+{
+	policy,
+	cached, /* the backend answered from it's own cache, without waiting */
+	fallback
+};
+
 enum class NetherDescriptorStatus : std::uint8_t
 {
 	readOnly,
@@ -153,11 +189,13 @@ enum class NetherProtocolType : std::uint8_t
 };
 
 
+typedef uint32_t NetherLabelId;
+
 struct NetherPacket
 {
 	uid_t uid;
 	u_int32_t id;
-	std::string securityContext;
+	NetherLabelId securityContext					= NETHER_NO_LABEL; /* see NetherLabelTable */
 	int32_t remotePort								= -1;
 	int32_t localPort								= -1;
 	gid_t gid;
@@ -167,6 +205,7 @@ struct NetherPacket
 	NetherTransportType transportType;
 	NetherProtocolType protocolType;
 	char outdevName[IFNAMSIZ]						= {0};
+	uint64_t receivedAt								= 0; /* monotonic nanoseconds */
 };
 
 struct NetherConfig
@@ -177,6 +216,7 @@ struct NetherConfig
 	NetherLogBackendType logBackend				= NETHER_LOG_BACKEND;
 	uint8_t markDeny							= NETLINK_DROP_MARK;
 	uint8_t markAllowAndLog						= NETLINK_ALLOWLOG_MARK;
+	uint8_t markAllow							= NETLINK_ALLOW_MARK;
 	int primaryBackendRetries					= 3;
 	int backupBackendRetries					= 3;
 	int debugMode								= 0;
@@ -187,18 +227,44 @@ struct NetherConfig
 	int copyPackets								= NETLINK_COPY_PACKETS;
 	int relaxed									= 0;
 	int interfaceInfo							= NETLINK_INTERFACE_INFO;
+	int batchVerdicts							= 0;
+	int receiveBatchSize						= 0;
+	int netlinkBudget							= NETHER_NETLINK_BUDGET;
+	int backendBudget							= NETHER_BACKEND_BUDGET;
+	int statisticsInterval						= NETHER_STATISTICS_INTERVAL;
+	int decisionCacheSize						= NETHER_DECISION_CACHE_SIZE;
+	int decisionCacheTtl						= NETHER_DECISION_CACHE_TTL;
+	int decisionSnapshotInterval				= NETHER_DECISION_SNAPSHOT_INTERVAL;
+	int hedgeDelay								= NETHER_HEDGE_DELAY;
+	int breakerThreshold						= NETHER_BREAKER_THRESHOLD;
+	int breakerOpenTime							= NETHER_BREAKER_OPEN_TIME;
+	int logQueueSize							= NETHER_LOG_QUEUE_SIZE;
+	int logQueueBlock							= 0;
+	int logRotateSize							= NETHER_LOG_ROTATE_SIZE;
+	int logRotateCount							= NETHER_LOG_ROTATE_COUNT;
+	int kernelQueueInterval						= NETHER_KERNEL_QUEUE_INTERVAL;
+	int queueDepthWarning						= NETHER_QUEUE_DEPTH_WARNING;
+	int queueMaxLength							= NETHER_QUEUE_MAXLEN;
+	int netlinkBufferSize						= NETHER_NETLINK_BUFFER_SIZE;
+	int failOpen								= 0;
+	int noEnobufs								= 0;
+	int pinQueues								= 0;
+	int connmarkVerdicts						= 0;
+	std::vector<int> queueNumbers;
 	std::string backupBackendArgs				= NETHER_POLICY_FILE;
 	std::string rulesPath						= NETHER_RULES_PATH;
 	std::string iptablesRestorePath				= NETHER_IPTABLES_RESTORE_PATH;
 	std::string primaryBackendArgs;
 	std::string logBackendArgs;
+	std::string decisionSnapshotPath;
+	std::string metricsSocket;
 };
 
 class NetherVerdictListener
 {
 	public:
 		virtual ~NetherVerdictListener() = default;
-		virtual bool verdictCast(const u_int32_t packetId, const NetherVerdict verdict, int mark) = 0;
+		virtual bool verdictCast(const u_int32_t packetId, const NetherVerdict verdict, int mark, const NetherVerdictPath path) = 0;
 };
 
 class NetherVerdictCaster
@@ -212,17 +278,19 @@ class NetherVerdictCaster
 			verdictListener = listenerToSet;
 		}
 
-		bool castVerdict(const NetherPacket &packet, const NetherVerdict verdict, const int32_t mark = -1)
+		bool castVerdict(const NetherPacket &packet, const NetherVerdict verdict, const int32_t mark = -1,
+						 const NetherVerdictPath path = NetherVerdictPath::policy)
 		{
 			if(verdictListener)
-				return (verdictListener->verdictCast(packet.id, verdict, mark));
+				return (verdictListener->verdictCast(packet.id, verdict, mark, path));
 			return (false);
 		}
 
-		bool castVerdict(const u_int32_t packetId, const NetherVerdict verdict, const int32_t mark = -1)
+		bool castVerdict(const u_int32_t packetId, const NetherVerdict verdict, const int32_t mark = -1,
+						 const NetherVerdictPath path = NetherVerdictPath::policy)
 		{
 			if(verdictListener)
-				return (verdictListener->verdictCast(packetId, verdict, mark));
+				return (verdictListener->verdictCast(packetId, verdict, mark, path));
 			return (false);
 		}
 
@@ -230,6 +298,13 @@ class NetherVerdictCaster
 		NetherVerdictListener *verdictListener;
 };
 
+class NetherDescriptorListener
+{
+	public:
+		virtual ~NetherDescriptorListener() = default;
+		virtual void descriptorChanged(const int oldDescriptor, const int newDescriptor, const NetherDescriptorStatus status) = 0;
+};
+
 class NetherProcessedPacketListener
 {
 	public:
@@ -252,7 +327,7 @@ class NetherPacketProcessor
 			packetListener = listenerToSet;
 		}
 
-		void processNetherPacket(NetherPacket packetInfoToWrite)
+		void processNetherPacket(const NetherPacket &packetInfoToWrite)
 		{
 			if(packetListener) packetListener->packetReceived(packetInfoToWrite);
 		}
@@ -26,12 +26,16 @@
 #define NETHER_UTILS_H
 
 #include "nether_Types.h"
+#include "nether_LabelTable.h"
 
-void decodePacket(NetherPacket &packet, unsigned char *payload);
-void decodeIPv4Packet(NetherPacket &packet, unsigned char *payload);
-void decodeIPv6Packet(NetherPacket &packet, unsigned char *payload);
-void decodeTcp(NetherPacket &packet, unsigned char *payload);
-void decodeUdp(NetherPacket &packet, unsigned char *payload);
+#include <time.h>
+
+void decodePacket(NetherPacket &packet, const unsigned char *payload, const int payloadLength);
+void decodeIPv4Packet(NetherPacket &packet, const unsigned char *payload, const int payloadLength);
+void decodeIPv6Packet(NetherPacket &packet, const unsigned char *payload, const int payloadLength);
+void decodeTransport(NetherPacket &packet, const uint8_t protocol, const unsigned char *payload, const int payloadLength);
+void decodeTcp(NetherPacket &packet, const unsigned char *payload, const int payloadLength);
+void decodeUdp(NetherPacket &packet, const unsigned char *payload, const int payloadLength);
 std::string ipAddressToString(const char *src, enum NetherProtocolType type);
 
 NetherVerdict stringToVerdict(char *verdictAsString);
@@ -45,4 +49,16 @@ std::string protocolToString(const NetherProtocolType protocolType);
 std::string packetToString(const NetherPacket &packet);
 template<typename ... Args> std::string stringFormat(const char* format, Args ... args);
 std::vector<std::string> tokenize(const std::string &str, const std::string &delimiters);
+bool parseQueueNumbers(const std::string &queuesAsString, std::vector<int> &queueNumbers);
+uint64_t fingerprint(const void *data, const size_t length, const uint64_t seed = NETHER_FINGERPRINT_SEED);
+uint64_t fingerprint(const std::string &str, const uint64_t seed = NETHER_FINGERPRINT_SEED);
+
+/* nanoseconds of the monotonic clock, it's read for every packet */
+inline uint64_t monotonicTime()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec);
+}
+
 #endif // NETHER_UTILS_H
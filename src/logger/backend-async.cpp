@@ -0,0 +1,274 @@
+/*
+ *  Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Roman Kubiak (r.kubiak@samsung.com)
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+
+/**
+ * @file
+ * @author  Roman Kubiak (r.kubiak@samsung.com)
+ * @brief   Asynchronous logging backend
+ */
+
+#include "logger/config.hpp"
+#include "logger/backend-async.hpp"
+#include "logger/formatter.hpp"
+
+#include <chrono>
+#include <cstring>
+
+namespace logger
+{
+
+	namespace
+	{
+
+		const std::chrono::milliseconds WRITER_IDLE_WAIT(100);
+		const std::chrono::milliseconds PRODUCER_FULL_WAIT(10);
+		const std::chrono::seconds DROP_REPORT_INTERVAL(1);
+
+	} // namespace
+
+	AsyncBackend::AsyncBackend(LogBackend *_backend, const size_t capacity, const OverflowPolicy _overflowPolicy)
+		: backend(_backend),
+		  overflowPolicy(_overflowPolicy),
+		  enqueuePosition(0),
+		  dequeuePosition(0),
+		  dropped(0),
+		  droppedReported(0),
+		  stopping(false),
+		  flushRequested(false),
+		  reopenRequested(false),
+		  writerWaiting(false),
+		  producersWaiting(0)
+	{
+		size_t size = 2;
+
+		while(size < capacity)
+			size <<= 1;
+
+		records.reset(new Record[size]);
+		mask = size - 1;
+
+		// a record at position n is free when it's sequence is n
+		for(size_t n = 0; n < size; n++)
+			records[n].sequence.store(n, std::memory_order_relaxed);
+
+		writerThread = std::thread(&AsyncBackend::writer, this);
+	}
+
+	AsyncBackend::~AsyncBackend()
+	{
+		{
+			std::lock_guard<std::mutex> lock(waitMutex);
+			stopping = true;
+			dataAvailable.notify_one();
+		}
+
+		writerThread.join();
+	}
+
+	void AsyncBackend::log(LogLevel logLevel,
+						   const std::string& file,
+						   const unsigned int& line,
+						   const std::string& func,
+						   const std::string& message)
+	{
+		while(!push(logLevel, file, line, func, message))
+		{
+			if(overflowPolicy == OverflowPolicy::DROP || stopping)
+			{
+				dropped++;
+				return;
+			}
+
+			std::unique_lock<std::mutex> lock(waitMutex);
+			producersWaiting++;
+			spaceAvailable.wait_for(lock, PRODUCER_FULL_WAIT);
+			producersWaiting--;
+		}
+
+		if(writerWaiting)
+			wakeWriter();
+	}
+
+	void AsyncBackend::flush()
+	{
+		flushRequested = true;
+		wakeWriter();
+	}
+
+	void AsyncBackend::reopen()
+	{
+		reopenRequested = true;
+		wakeWriter();
+	}
+
+	void AsyncBackend::wakeWriter()
+	{
+		std::lock_guard<std::mutex> lock(waitMutex);
+		dataAvailable.notify_one();
+	}
+
+	bool AsyncBackend::isThreadSafe() const
+	{
+		return true;
+	}
+
+	uint64_t AsyncBackend::getDropped() const
+	{
+		return dropped.load(std::memory_order_relaxed);
+	}
+
+	// bounded multi producer queue, a producer claims a position
+	// and publishes the record by moving it's sequence forward
+	bool AsyncBackend::push(LogLevel logLevel,
+							const std::string& file,
+							const unsigned int& line,
+							const std::string& func,
+							const std::string& message)
+	{
+		size_t position = enqueuePosition.load(std::memory_order_relaxed);
+		Record *record;
+
+		for(;;)
+		{
+			record = &records[position & mask];
+			const size_t sequence = record->sequence.load(std::memory_order_acquire);
+			const intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+
+			if(difference == 0)
+			{
+				if(enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+					break;
+			}
+			else if(difference < 0)
+			{
+				// the writer did not get to this record yet, we're full
+				return false;
+			}
+			else
+			{
+				position = enqueuePosition.load(std::memory_order_relaxed);
+			}
+		}
+
+		record->logLevel = logLevel;
+		record->line = line;
+		record->threadId = LogFormatter::getCurrentThread();
+		gettimeofday(&record->time, NULL);
+		copyField(record->file, sizeof(record->file), file);
+		copyField(record->func, sizeof(record->func), func);
+		copyField(record->message, sizeof(record->message), message);
+
+		record->sequence.store(position + 1, std::memory_order_release);
+		return true;
+	}
+
+	size_t AsyncBackend::drain()
+	{
+		size_t written = 0;
+
+		for(;;)
+		{
+			Record &record = records[dequeuePosition & mask];
+
+			if(record.sequence.load(std::memory_order_acquire) != dequeuePosition + 1)
+				break;
+
+			// the header shows when and where the message was logged, not written
+			LogFormatter::setRecordOrigin(&record.time, record.threadId);
+			backend->log(record.logLevel, record.file, record.line, record.func, record.message);
+			LogFormatter::setRecordOrigin(nullptr, 0);
+
+			record.sequence.store(dequeuePosition + mask + 1, std::memory_order_release);
+			dequeuePosition++;
+			written++;
+		}
+
+		if(written > 0 && producersWaiting > 0)
+		{
+			std::lock_guard<std::mutex> lock(waitMutex);
+			spaceAvailable.notify_all();
+		}
+
+		return written;
+	}
+
+	void AsyncBackend::reportDropped()
+	{
+		const uint64_t droppedNow = dropped.load(std::memory_order_relaxed);
+
+		if(droppedNow != droppedReported)
+		{
+			backend->log(LogLevel::WARN, __FILE__, __LINE__, __func__,
+						 std::to_string(droppedNow - droppedReported) + " log message(s) dropped, the log queue was full");
+			droppedReported = droppedNow;
+		}
+	}
+
+	void AsyncBackend::writer()
+	{
+		auto lastDropReport = std::chrono::steady_clock::now();
+
+		for(;;)
+		{
+			const size_t written = drain();
+
+			// while the queue overflows, one summary a second is enough
+			if(std::chrono::steady_clock::now() - lastDropReport >= DROP_REPORT_INTERVAL)
+			{
+				reportDropped();
+				lastDropReport = std::chrono::steady_clock::now();
+			}
+
+			if(reopenRequested.exchange(false))
+				backend->reopen();
+
+			if(written > 0 && !flushRequested)
+				continue;
+
+			// nothing more to write for now, don't keep anything buffered
+			flushRequested = false;
+			backend->flush();
+
+			std::unique_lock<std::mutex> lock(waitMutex);
+
+			if(stopping)
+			{
+				lock.unlock();
+				drain();
+				reportDropped();
+				return;
+			}
+
+			// producers only wake us up when we say we're waiting
+			writerWaiting = true;
+			if(records[dequeuePosition & mask].sequence.load(std::memory_order_acquire) != dequeuePosition + 1 &&
+					!flushRequested && !reopenRequested)
+				dataAvailable.wait_for(lock, WRITER_IDLE_WAIT);
+			writerWaiting = false;
+		}
+	}
+
+	void AsyncBackend::copyField(char *field, const size_t fieldSize, const std::string& value)
+	{
+		const size_t length = std::min(value.size(), fieldSize - 1);
+
+		memcpy(field, value.data(), length);
+		field[length] = '\0';
+	}
+
+} // namespace logger
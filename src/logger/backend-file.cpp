@@ -26,22 +26,134 @@
 #include "logger/formatter.hpp"
 #include "logger/backend-file.hpp"
 
-#include <fstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <cstdio>
 
 namespace logger
 {
 
+	namespace
+	{
+
+		const size_t FLUSH_SIZE = 32 * 1024;
+		const std::chrono::seconds FLUSH_INTERVAL(1);
+
+	} // namespace
+
+	FileBackend::FileBackend(const std::string &filePath, const size_t _rotateSize, const unsigned int _rotateCount)
+		: mfilePath(filePath),
+		  rotateSize(_rotateSize),
+		  rotateCount(_rotateCount > 0 ? _rotateCount : 1),
+		  fileDescriptor(-1),
+		  fileSize(0),
+		  lastFlush(std::chrono::steady_clock::now())
+	{
+		buffer.reserve(FLUSH_SIZE * 2);
+		open();
+	}
+
+	FileBackend::~FileBackend()
+	{
+		flush();
+		close();
+	}
+
 	void FileBackend::log(LogLevel logLevel,
 						  const std::string& file,
 						  const unsigned int& line,
 						  const std::string& func,
 						  const std::string& message)
 	{
-		std::ofstream out(mfilePath, std::ios::app);
-		out << LogFormatter::getHeader(logLevel, file, line, func);
-		out << message;
-		out << std::endl;
+		char header[LOG_HEADER_LENGTH];
+		buffer.append(header, LogFormatter::formatHeader(header, sizeof(header), logLevel, file, line, func));
+		buffer.append(message);
+		buffer.push_back('\n');
+
+		// errors are often the last thing logged before we exit
+		if(logLevel >= LogLevel::ERROR ||
+				buffer.size() >= FLUSH_SIZE ||
+				std::chrono::steady_clock::now() - lastFlush >= FLUSH_INTERVAL)
+		{
+			flush();
+		}
+	}
+
+	void FileBackend::flush()
+	{
+		size_t written = 0;
+
+		lastFlush = std::chrono::steady_clock::now();
+
+		if(buffer.empty())
+			return;
+
+		if(fileDescriptor == -1)
+			open();
+
+		while(fileDescriptor != -1 && written < buffer.size())
+		{
+			const ssize_t result = ::write(fileDescriptor, buffer.data() + written, buffer.size() - written);
+
+			if(result < 0 && errno == EINTR)
+				continue;
+
+			if(result <= 0)
+				break;
+
+			written += result;
+		}
+
+		// what could not be written is lost, the buffer must not grow forever
+		fileSize += written;
+		buffer.clear();
+
+		if(rotateSize > 0 && fileSize >= rotateSize)
+			rotate();
+	}
+
+	void FileBackend::reopen()
+	{
+		flush();
+		close();
+		open();
 	}
 
+	void FileBackend::open()
+	{
+		struct stat fileStat;
+
+		fileDescriptor = ::open(mfilePath.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0640);
+
+		if(fileDescriptor != -1 && fstat(fileDescriptor, &fileStat) == 0)
+			fileSize = fileStat.st_size;
+		else
+			fileSize = 0;
+	}
+
+	void FileBackend::close()
+	{
+		if(fileDescriptor != -1)
+		{
+			::close(fileDescriptor);
+			fileDescriptor = -1;
+		}
+	}
+
+	void FileBackend::rotate()
+	{
+		close();
+
+		// file.N-1 -> file.N ... file -> file.1, the oldest one is overwritten
+		for(unsigned int n = rotateCount; n > 0; n--)
+		{
+			const std::string from = n > 1 ? mfilePath + "." + std::to_string(n - 1) : mfilePath;
+			::rename(from.c_str(), (mfilePath + "." + std::to_string(n)).c_str());
+		}
+
+		open();
+	}
 
 } // namespace logger
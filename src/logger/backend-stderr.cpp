@@ -48,7 +48,8 @@ namespace logger
 
 		const std::string logColor = LogFormatter::getConsoleColor(logLevel);
 		const std::string defaultColor = LogFormatter::getDefaultConsoleColor();
-		const std::string header = LogFormatter::getHeader(logLevel, file, line, func);
+		char header[LOG_HEADER_LENGTH];
+		LogFormatter::formatHeader(header, sizeof(header), logLevel, file, line, func);
 		tokenizer tokens(message, charSeparator("\n"));
 		for(const auto& messageLine : tokens)
 		{
@@ -57,13 +58,15 @@ namespace logger
 				fprintf(stderr,
 						"%s%s %s%s\n",
 						useColours ? logColor.c_str() : "",
-						header.c_str(),
+						header,
 						messageLine.c_str(),
 						useColours ? defaultColor.c_str() : "");
 			}
 		}
 #else
-		fprintf(stderr, "%s %s\n", LogFormatter::getHeader(logLevel, file, line, func).c_str(), message.c_str());
+		char header[LOG_HEADER_LENGTH];
+		LogFormatter::formatHeader(header, sizeof(header), logLevel, file, line, func);
+		fprintf(stderr, "%s %s\n", header, message.c_str());
 #endif
 	}
 
@@ -63,7 +63,9 @@ namespace logger
 							const std::string& func,
 							const std::string& message)
 	{
-		syslog(toSyslogPriority(logLevel), "%s %s", LogFormatter::getHeader(logLevel, file, line, func).c_str(), message.c_str());
+		char header[LOG_HEADER_LENGTH];
+		LogFormatter::formatHeader(header, sizeof(header), logLevel, file, line, func);
+		syslog(toSyslogPriority(logLevel), "%s %s", header, message.c_str());
 	}
 
 } // namespace logger
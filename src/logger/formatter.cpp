@@ -28,10 +28,11 @@
 
 #include <sys/time.h>
 #include <cassert>
-#include <sstream>
-#include <iomanip>
 #include <thread>
 #include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <ctime>
 
 namespace logger
 {
@@ -47,10 +48,88 @@ namespace logger
 		std::atomic<unsigned int> gNextThreadId(1);
 		thread_local unsigned int gThisThreadId(0);
 
+		// set while a message logged earlier, by another thread, is written
+		thread_local const struct timeval *gRecordTime(nullptr);
+		thread_local unsigned int gRecordThreadId(0);
+
+		// localtime() is only needed when the second changes
+		thread_local time_t gCachedSecond(-1);
+		thread_local char gCachedTime[sizeof("hh:mm:ss")];
+
+		class HeaderBuffer
+		{
+			public:
+				HeaderBuffer(char *_buffer, const size_t _size)
+					: buffer(_buffer), size(_size), length(0) {}
+
+				void append(const char *data, const size_t dataLength)
+				{
+					const size_t copied = std::min(dataLength, size - 1 - length);
+					memcpy(buffer + length, data, copied);
+					length += copied;
+				}
+
+				void append(const std::string& data)
+				{
+					append(data.data(), data.size());
+				}
+
+				void append(const char character)
+				{
+					append(&character, 1);
+				}
+
+				void append(unsigned int number, const size_t width = 0)
+				{
+					char digits[16];
+					size_t count = 0;
+
+					do
+					{
+						digits[sizeof(digits) - ++count] = '0' + number % 10;
+						number /= 10;
+					}
+					while(number > 0);
+
+					for(size_t n = count; n < width; n++)
+						append(' ');
+
+					append(digits + sizeof(digits) - count, count);
+				}
+
+				// like std::setw() with std::left
+				void padTo(const size_t column)
+				{
+					while(length < column && length < size - 1)
+						buffer[length++] = ' ';
+				}
+
+				size_t getLength() const
+				{
+					return length;
+				}
+
+				size_t finish()
+				{
+					buffer[length] = '\0';
+					return length;
+				}
+
+			private:
+				char *buffer;
+				size_t size;
+				size_t length;
+		};
+
 	} // namespace
 
 	unsigned int LogFormatter::getCurrentThread(void)
 	{
+		if(gRecordThreadId != 0)
+		{
+			return gRecordThreadId;
+		}
+
 		unsigned int id = gThisThreadId;
 		if(id == 0)
 		{
@@ -60,20 +139,45 @@ namespace logger
 		return id;
 	}
 
-	std::string LogFormatter::getCurrentTime(void)
+	void LogFormatter::setRecordOrigin(const struct timeval *time, const unsigned int threadId)
+	{
+		gRecordTime = time;
+		gRecordThreadId = threadId;
+	}
+
+	void LogFormatter::formatTime(char *time)
 	{
-		char time[TIME_COLUMN_LENGTH + 1];
 		struct timeval tv;
-		gettimeofday(&tv, NULL);
-		struct tm* tm = localtime(&tv.tv_sec);
-		snprintf(time,
-				 sizeof(time),
-				 "%02d:%02d:%02d.%03d",
-				 tm->tm_hour,
-				 tm->tm_min,
-				 tm->tm_sec,
-				 int(tv.tv_usec / 1000));
+		if(gRecordTime != nullptr)
+		{
+			tv = *gRecordTime;
+		}
+		else
+		{
+			gettimeofday(&tv, NULL);
+		}
+
+		if(tv.tv_sec != gCachedSecond)
+		{
+			struct tm tm;
+			localtime_r(&tv.tv_sec, &tm);
+			snprintf(gCachedTime, sizeof(gCachedTime), "%02d:%02d:%02d", tm.tm_hour, tm.tm_min, tm.tm_sec);
+			gCachedSecond = tv.tv_sec;
+		}
 
+		const int milliseconds = tv.tv_usec / 1000;
+		memcpy(time, gCachedTime, sizeof(gCachedTime) - 1);
+		time[8] = '.';
+		time[9] = '0' + milliseconds / 100;
+		time[10] = '0' + milliseconds / 10 % 10;
+		time[11] = '0' + milliseconds % 10;
+		time[TIME_COLUMN_LENGTH] = '\0';
+	}
+
+	std::string LogFormatter::getCurrentTime(void)
+	{
+		char time[TIME_COLUMN_LENGTH + 1];
+		formatTime(time);
 		return std::string(time);
 	}
 
@@ -125,13 +229,49 @@ namespace logger
 										const unsigned int& line,
 										const std::string& func)
 	{
-		std::ostringstream logLine;
-		logLine << getCurrentTime() << ' '
-				<< std::left << std::setw(SEVERITY_COLUMN_LENGTH) << '[' + toString(logLevel) + ']'
-				<< std::right << std::setw(THREAD_COLUMN_LENGTH) << getCurrentThread() << ": "
-				<< std::left << std::setw(FILE_COLUMN_LENGTH)
-				<< file + ':' + std::to_string(line) + ' ' + func + ':';
-		return logLine.str();
+		char header[LOG_HEADER_LENGTH];
+		return std::string(header, formatHeader(header, sizeof(header), logLevel, file, line, func));
+	}
+
+	size_t LogFormatter::formatHeader(char *buffer,
+									  const size_t size,
+									  LogLevel logLevel,
+									  const std::string& file,
+									  const unsigned int& line,
+									  const std::string& func)
+	{
+		char time[TIME_COLUMN_LENGTH + 1];
+		HeaderBuffer header(buffer, size);
+		size_t columnStart;
+
+		if(size == 0)
+		{
+			return 0;
+		}
+
+		formatTime(time);
+		header.append(time, TIME_COLUMN_LENGTH);
+		header.append(' ');
+
+		columnStart = header.getLength();
+		header.append('[');
+		header.append(toString(logLevel));
+		header.append(']');
+		header.padTo(columnStart + SEVERITY_COLUMN_LENGTH);
+
+		header.append(getCurrentThread(), THREAD_COLUMN_LENGTH);
+		header.append(": ", 2);
+
+		columnStart = header.getLength();
+		header.append(file);
+		header.append(':');
+		header.append(line);
+		header.append(' ');
+		header.append(func);
+		header.append(':');
+		header.padTo(columnStart + FILE_COLUMN_LENGTH);
+
+		return header.finish();
 	}
 
 } // namespace logger
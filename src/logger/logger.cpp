@@ -27,6 +27,8 @@
 #include "logger/formatter.hpp"
 #include "logger/backend-null.hpp"
 
+#include <algorithm>
+#include <chrono>
 #include <memory>
 #include <mutex>
 
@@ -39,6 +41,14 @@ namespace logger
 		volatile LogLevel gLogLevel = LogLevel::DEBUG;
 		std::unique_ptr<LogBackend> gLogBackendPtr(new NullLogger());
 		std::mutex gLogMutex;
+		// every rate limited call site is added once, when it's first reached, and never removed
+		std::atomic<RateLimit*> gRateLimits(nullptr);
+
+		int64_t rateLimitNow(void)
+		{
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(
+					   std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
 
 	} // namespace
 
@@ -50,6 +60,14 @@ namespace logger
 							const std::string& rootDir)
 	{
 		std::string sfile = LogFormatter::stripProjectDir(file, rootDir);
+
+		// the backend is only replaced before other threads start logging
+		if(gLogBackendPtr->isThreadSafe())
+		{
+			gLogBackendPtr->log(logLevel, sfile, line, func, message);
+			return;
+		}
+
 		std::unique_lock<std::mutex> lock(gLogMutex);
 		gLogBackendPtr->log(logLevel, sfile, line, func, message);
 	}
@@ -69,10 +87,120 @@ namespace logger
 		return gLogLevel;
 	}
 
+	void Logger::flush(void)
+	{
+		if(gLogBackendPtr->isThreadSafe())
+		{
+			gLogBackendPtr->flush();
+			return;
+		}
+
+		std::unique_lock<std::mutex> lock(gLogMutex);
+		gLogBackendPtr->flush();
+	}
+
+	void Logger::reopen(void)
+	{
+		if(gLogBackendPtr->isThreadSafe())
+		{
+			gLogBackendPtr->reopen();
+			return;
+		}
+
+		std::unique_lock<std::mutex> lock(gLogMutex);
+		gLogBackendPtr->reopen();
+	}
+
+	uint64_t Logger::getDropped(void)
+	{
+		if(gLogBackendPtr->isThreadSafe())
+			return gLogBackendPtr->getDropped();
+
+		std::unique_lock<std::mutex> lock(gLogMutex);
+		return gLogBackendPtr->getDropped();
+	}
+
 	void Logger::setLogBackend(LogBackend* pBackend)
 	{
 		std::unique_lock<std::mutex> lock(gLogMutex);
 		gLogBackendPtr.reset(pBackend);
 	}
 
+	RateLimit::RateLimit(const unsigned int burst,
+						 const unsigned int intervalMs,
+						 const LogLevel logLevel,
+						 const char* file,
+						 const unsigned int line,
+						 const char* func,
+						 const char* rootDir)
+		: interval(int64_t(intervalMs) * 1000000),
+		  limit(int64_t(burst) * int64_t(intervalMs) * 1000000),
+		  logLevel(logLevel),
+		  file(file),
+		  line(line),
+		  func(func),
+		  rootDir(rootDir),
+		  nextArrival(0),
+		  suppressedCount(0),
+		  next(gRateLimits.load(std::memory_order_relaxed))
+	{
+		while(!gRateLimits.compare_exchange_weak(next, this, std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	// every message moves the next arrival time one interval forward,
+	// a message that would move it more then burst intervals ahead is not allowed
+	bool RateLimit::take(const int64_t now)
+	{
+		int64_t arrival = nextArrival.load(std::memory_order_relaxed);
+		int64_t newArrival;
+
+		do
+		{
+			newArrival = std::max(arrival, now) + interval;
+
+			if(newArrival - now > limit)
+				return false;
+		}
+		while(!nextArrival.compare_exchange_weak(arrival, newArrival, std::memory_order_relaxed));
+
+		return true;
+	}
+
+	bool RateLimit::allow(uint64_t& suppressed)
+	{
+		if(!take(rateLimitNow()))
+		{
+			suppressedCount.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+
+		suppressed = suppressedCount.exchange(0, std::memory_order_relaxed);
+		return true;
+	}
+
+	// the summary takes a token like any other message, so it's logged
+	// only once the flood has stopped long enough for the bucket to refill
+	void RateLimit::flushSuppressed(void)
+	{
+		const int64_t now = rateLimitNow();
+
+		for(RateLimit* rateLimit = gRateLimits.load(std::memory_order_acquire); rateLimit; rateLimit = rateLimit->next)
+		{
+			if(rateLimit->suppressedCount.load(std::memory_order_relaxed) == 0 || !rateLimit->take(now))
+				continue;
+
+			const uint64_t suppressed = rateLimit->suppressedCount.exchange(0, std::memory_order_relaxed);
+
+			if(suppressed > 0 && Logger::getLogLevel() <= rateLimit->logLevel)
+			{
+				Logger::logMessage(rateLimit->logLevel,
+								   std::to_string(suppressed) + " similar message(s) suppressed",
+								   rateLimit->file,
+								   rateLimit->line,
+								   rateLimit->func,
+								   rateLimit->rootDir);
+			}
+		}
+	}
+
 } // namespace logger
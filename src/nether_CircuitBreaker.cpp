@@ -0,0 +1,180 @@
+/*
+ *  Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Roman Kubiak (r.kubiak@samsung.com)
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+
+/**
+ * @file
+ * @author  Roman Kubiak (r.kubiak@samsung.com)
+ * @brief   Circuit breaker in front of a policy backend
+ */
+
+#include "nether_CircuitBreaker.h"
+
+NetherCircuitBreaker::NetherCircuitBreaker(const std::string &_name, const unsigned int _failureThreshold, const unsigned int _openTimeMs)
+	:	name(_name),
+		failureThreshold(_failureThreshold),
+		openTime(_openTimeMs),
+		state(NetherCircuitState::closed),
+		consecutiveFailures(0),
+		timesOpened(0),
+		probes(0),
+		timesClosed(0),
+		requestsRejected(0),
+		metrics(nullptr)
+{
+}
+
+bool NetherCircuitBreaker::allowRequest()
+{
+	switch(state)
+	{
+		case NetherCircuitState::closed:
+			return (true);
+
+		case NetherCircuitState::open:
+			if(std::chrono::steady_clock::now() < openUntil)
+				break;
+
+			/* this request is the probe */
+			setState(NetherCircuitState::halfOpen);
+			probes++;
+			if(metrics)
+				metrics->probes.add();
+			return (true);
+
+		case NetherCircuitState::halfOpen:
+			/* only one probe at a time */
+			break;
+	}
+
+	requestsRejected++;
+	return (false);
+}
+
+void NetherCircuitBreaker::recordSuccess()
+{
+	consecutiveFailures = 0;
+
+	if(state != NetherCircuitState::closed)
+		setState(NetherCircuitState::closed);
+}
+
+void NetherCircuitBreaker::recordFailure()
+{
+	consecutiveFailures++;
+
+	if(state == NetherCircuitState::halfOpen ||
+			(state == NetherCircuitState::closed && failureThreshold > 0 && consecutiveFailures >= failureThreshold))
+	{
+		openUntil = std::chrono::steady_clock::now() + openTime;
+		setState(NetherCircuitState::open);
+	}
+}
+
+/* A backend without room for the request says nothing about it's health,
+	it does not count as a failure. A probe turned away this way is
+	repeated with the next request */
+void NetherCircuitBreaker::recordBusy()
+{
+	if(state != NetherCircuitState::halfOpen)
+		return;
+
+	LOGD(name << " backend circuit probe not taken, backend busy");
+	openUntil	= std::chrono::steady_clock::now();
+	state		= NetherCircuitState::open;
+
+	if(metrics)
+		metrics->state.set((uint64_t)state);
+}
+
+void NetherCircuitBreaker::setState(const NetherCircuitState newState)
+{
+	if(newState == NetherCircuitState::open)
+	{
+		LOGW(name << " backend circuit " << stateToString(state) << " -> open after "
+			 << consecutiveFailures << " failure(s), retrying in " << openTime.count() << "ms");
+		timesOpened++;
+		if(metrics)
+			metrics->opened.add();
+	}
+	else if(newState == NetherCircuitState::closed)
+	{
+		LOGI(name << " backend circuit " << stateToString(state) << " -> closed, backend recovered");
+		timesClosed++;
+		if(metrics)
+			metrics->closed.add();
+	}
+	else
+	{
+		LOGD(name << " backend circuit " << stateToString(state) << " -> " << stateToString(newState));
+	}
+
+	state = newState;
+
+	if(metrics)
+		metrics->state.set((uint64_t)state);
+}
+
+void NetherCircuitBreaker::setMetrics(NetherCircuitMetrics *metricsToSet)
+{
+	metrics = metricsToSet;
+}
+
+NetherCircuitState NetherCircuitBreaker::getState() const
+{
+	return (state);
+}
+
+const std::string &NetherCircuitBreaker::getName() const
+{
+	return (name);
+}
+
+uint64_t NetherCircuitBreaker::getTimesOpened() const
+{
+	return (timesOpened);
+}
+
+uint64_t NetherCircuitBreaker::getProbes() const
+{
+	return (probes);
+}
+
+uint64_t NetherCircuitBreaker::getTimesClosed() const
+{
+	return (timesClosed);
+}
+
+uint64_t NetherCircuitBreaker::getRequestsRejected() const
+{
+	return (requestsRejected);
+}
+
+std::string NetherCircuitBreaker::stateToString(const NetherCircuitState state)
+{
+	switch(state)
+	{
+		case NetherCircuitState::closed:
+			return ("closed");
+		case NetherCircuitState::open:
+			return ("open");
+		case NetherCircuitState::halfOpen:
+			return ("half-open");
+	}
+
+	return ("unknown");
+}
@@ -43,9 +43,24 @@ const std::string cynaraErrorCodeToString(int cynaraErrorCode)
 }
 
 NetherCynaraBackend::NetherCynaraBackend(const NetherConfig &netherConfig)
-	:   NetherPolicyBackend(netherConfig), currentCynaraDescriptor(0),
+	:   NetherPolicyBackend(netherConfig), currentCynaraDescriptorStatus(NetherDescriptorStatus::unknownStatus),
+		currentCynaraDescriptor(-1),
 		cynaraLastResult(CYNARA_API_UNKNOWN_ERROR), cynaraConfig(nullptr),
-		allPrivilegesToCheck(1) /* if there is no additional policy, only one check is done */
+		allPrivilegesToCheck(1), /* if there is no additional policy, only one check is done */
+		maxPending(NETHER_CYNARA_MAX_PENDING),
+		checkTimeout(NETHER_CYNARA_TIMEOUT),
+		parallelChain(false),
+		warmupWindow(NETHER_CYNARA_WARMUP_WINDOW),
+		warmupNext(0),
+		warmupInFlight(0),
+		warmupChecked(0),
+		warmupLogged(0),
+		warmupRunning(false),
+		checkTimeouts(0),
+		checksRejected(0),
+		checksCreated(0),
+		checksCoalesced(0),
+		checksCancelled(0)
 {
 	/* This is the default, if no policy is defined in the file or no
 		privilege name is passed in the command line, the built in
@@ -57,10 +72,25 @@ NetherCynaraBackend::NetherCynaraBackend(const NetherConfig &netherConfig)
 	{
 		parseBackendArgs();
 	}
+
+	pendingChecks = std::unique_ptr<NetherCynaraPendingTable> (new NetherCynaraPendingTable(maxPending));
+
+	/* every chain has at least one pending check */
+	if(parallelChain)
+	{
+		chains.resize(maxPending);
+		chainKeys.reserve(maxPending);
+
+		for(size_t chainIndex = maxPending; chainIndex > 0; chainIndex--)
+			freeChains.push_back(chainIndex - 1);
+	}
 }
 
 NetherCynaraBackend::~NetherCynaraBackend()
 {
+	if(!warmupRecordPath.empty())
+		saveWarmupRecord();
+
 	cynara_async_configuration_destroy(cynaraConfig);
 }
 
@@ -73,10 +103,159 @@ bool NetherCynaraBackend::initialize()
 		return (false);
 	}
 
+	/* Fill the cynara client cache with the answers for applications
+		we expect to see, the checks are answered in the background
+		while the first packets arrive */
+	if(!warmupPath.empty())
+		loadWarmup(warmupPath);
+
+	if(!warmupRecordPath.empty())
+		loadWarmup(warmupRecordPath + "." + std::to_string(netherConfig.queueNumber));
+
+	if(!warmupEntries.empty())
+	{
+		LOGI("cynara warm-up started for " << warmupEntries.size() << " security context(s) and uid(s)");
+		warmupRunning	= true;
+		warmupStart		= std::chrono::steady_clock::now();
+		issueWarmupChecks();
+	}
+
 	return (true);
 }
 
-void NetherCynaraBackend::statusCallback(int , int newFd, cynara_async_status status, void *data)
+bool NetherCynaraBackend::loadWarmup(const std::string &path)
+{
+	std::ifstream warmupStream(path);
+	std::string line, label;
+	uid_t uid;
+
+	if(!warmupStream.good())
+	{
+		LOGW("Can't open cynara warm-up file: " << path);
+		return (false);
+	}
+
+	/* each line is "uid security-context" */
+	while(std::getline(warmupStream, line))
+	{
+		std::istringstream lineStream(line);
+
+		if(line.empty() || line[0] == '#')
+			continue;
+
+		if(!(lineStream >> uid >> label))
+		{
+			LOGW("Malformed warm-up entry: " << line << " in file: " << path);
+			continue;
+		}
+
+		if(seenEntries.size() == NETHER_CYNARA_WARMUP_ENTRIES)
+		{
+			LOGW("Only the first " << NETHER_CYNARA_WARMUP_ENTRIES << " warm-up entries of: " << path << " are used");
+			break;
+		}
+
+		const NetherLabelId labelId = NetherLabelTable::intern(label);
+
+		if(seenEntries.insert(((uint64_t)labelId << 32) | uid).second)
+			warmupEntries.push_back(std::make_pair(labelId, uid));
+	}
+
+	return (true);
+}
+
+void NetherCynaraBackend::saveWarmupRecord()
+{
+	const std::string path = warmupRecordPath + "." + std::to_string(netherConfig.queueNumber);
+	std::ofstream recordStream(path + ".tmp");
+
+	for(auto &entry : seenEntries)
+		recordStream << (uid_t)(entry & 0xffffffff) << " " << NetherLabelTable::toString(entry >> 32) << "\n";
+
+	recordStream.close();
+
+	if(!recordStream || rename((path + ".tmp").c_str(), path.c_str()) != 0)
+		LOGW("Failed to write cynara warm-up record: " << path);
+	else
+		LOGI("cynara warm-up record of " << seenEntries.size() << " entries written to: " << path);
+}
+
+void NetherCynaraBackend::issueWarmupChecks()
+{
+	const size_t warmupTotal = warmupEntries.size() * allPrivilegesToCheck;
+
+	/* at most warmupWindow checks at once, and leave half of the
+		pending table to the packets */
+	while(warmupRunning &&
+			warmupNext < warmupTotal &&
+			warmupInFlight < warmupWindow &&
+			pendingChecks->getFree() > pendingChecks->getCapacity() / 2)
+	{
+		NetherPacket packet;
+		packet.securityContext	= warmupEntries[warmupNext / allPrivilegesToCheck].first;
+		packet.uid				= warmupEntries[warmupNext / allPrivilegesToCheck].second;
+		packet.id				= 0;
+
+		NetherCynaraCheckInfo checkInfo(packet, warmupNext % allPrivilegesToCheck);
+		warmupNext++;
+
+		cynaraLastResult = cynara_async_check_cache(cynaraContext,
+						   NetherLabelTable::toString(packet.securityContext).c_str(),
+						   "",
+						   NetherCynaraUser(packet.uid).c_str(),
+						   privilegeChain[checkInfo.privilegeId].first.c_str());
+
+		if(cynaraLastResult != CYNARA_API_CACHE_MISS || pendingChecks->findInFlight(checkInfo) != NETHER_CYNARA_NO_SLOT)
+		{
+			warmupCheckDone();
+			continue;
+		}
+
+		cynaraLastResult = cynara_async_create_request(cynaraContext,
+						   NetherLabelTable::toString(packet.securityContext).c_str(),
+						   "",
+						   NetherCynaraUser(packet.uid).c_str(),
+						   privilegeChain[checkInfo.privilegeId].first.c_str(),
+						   &checkInfo.checkId,
+						   &checkCallback,
+						   this);
+
+		if(cynaraLastResult != CYNARA_API_SUCCESS)
+		{
+			LOGW("cynara warm-up stopped after " << warmupChecked << " checks: " << cynaraErrorCodeToString(cynaraLastResult));
+			warmupRunning = false;
+			return;
+		}
+
+		const u_int32_t slot = pendingChecks->add(checkInfo, std::chrono::steady_clock::now() + std::chrono::milliseconds(checkTimeout));
+		pendingChecks->get(slot).packetIds.clear();
+		pendingChecks->get(slot).warmup = true;
+		warmupInFlight++;
+		countPendingChecks();
+	}
+}
+
+void NetherCynaraBackend::warmupCheckDone()
+{
+	const size_t warmupTotal = warmupEntries.size() * allPrivilegesToCheck;
+
+	warmupChecked++;
+
+	if(warmupChecked * 10 / warmupTotal > warmupLogged)
+	{
+		warmupLogged = warmupChecked * 10 / warmupTotal;
+		LOGI("cynara warm-up " << warmupLogged * 10 << "% (" << warmupChecked << " of " << warmupTotal << " checks)");
+	}
+
+	if(warmupChecked == warmupTotal)
+	{
+		LOGI("cynara warm-up done, " << warmupTotal << " checks in "
+			 << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - warmupStart).count() << "ms");
+		warmupRunning = false;
+	}
+}
+
+void NetherCynaraBackend::statusCallback(int oldFd, int newFd, cynara_async_status status, void *data)
 {
 	NetherCynaraBackend *backend = static_cast<NetherCynaraBackend *>(data);
 
@@ -85,6 +264,10 @@ void NetherCynaraBackend::statusCallback(int , int newFd, cynara_async_status st
 
 	if(status == CYNARA_STATUS_FOR_RW)
 		backend->setCynaraDescriptor(newFd, NetherDescriptorStatus::readWrite);
+
+	/* this is the only place the descriptor can change, let the
+		event loop know so it can re-arm it */
+	backend->notifyDescriptorChanged(oldFd, newFd, backend->getDescriptorStatus());
 }
 
 void NetherCynaraBackend::checkCallback(cynara_check_id check_id,
@@ -93,24 +276,72 @@ void NetherCynaraBackend::checkCallback(cynara_check_id check_id,
 										void *data)
 {
 	NetherCynaraBackend *backend = static_cast<NetherCynaraBackend *>(data);
+	const u_int32_t slot = backend->pendingChecks->find(check_id);
 
-	if(cause == CYNARA_CALL_CAUSE_ANSWER)
-		backend->setCynaraVerdict(check_id, response);
-	else
-		LOGI("unknown reason for call cause="<< cause <<" response="<< response);
+	if(slot == NETHER_CYNARA_NO_SLOT)
+	{
+		LOGW_RATELIMITED("answer for unknown check id=" << check_id << " cause=" << cause);
+		return;
+	}
+
+	/* the slot is free before the chain goes on, the next check can use it */
+	NetherCynaraCheckInfo checkInfo			= backend->pendingChecks->get(slot).checkInfo;
+	const bool abandoned					= backend->pendingChecks->get(slot).abandoned;
+	const u_int32_t chainIndex				= backend->pendingChecks->get(slot).chain;
+	const bool warmup						= backend->pendingChecks->get(slot).warmup;
+	std::vector<u_int32_t> packetIds;
+	packetIds.swap(backend->pendingChecks->get(slot).packetIds);
+	backend->pendingChecks->release(slot);
+	backend->countPendingChecks();
+
+	if(warmup)
+	{
+		backend->warmupInFlight--;
+		backend->warmupCheckDone();
+		backend->issueWarmupChecks();
+	}
+
+	if(chainIndex != NETHER_CYNARA_NO_SLOT)
+	{
+		backend->setChainAnswer(chainIndex, checkInfo.privilegeId, cause, response);
+		return;
+	}
+
+	/* the default verdict was already used for those packets */
+	if(abandoned)
+		return;
+
+	if(cause != CYNARA_CALL_CAUSE_ANSWER)
+		LOGW_RATELIMITED("check id=" << check_id << " not answered cause=" << cause << ", using default verdict");
+
+	checkInfo.answered = true;
+
+	/* every packet that joined this check gets the same answer */
+	for(auto packetId : packetIds)
+	{
+		checkInfo.packet.id = packetId;
+
+		if(cause == CYNARA_CALL_CAUSE_ANSWER)
+			backend->setCynaraVerdict(checkInfo, response);
+		else
+			backend->castVerdict(packetId, backend->netherConfig.defaultVerdict, -1, NetherVerdictPath::fallback);
+	}
 }
 
 bool NetherCynaraBackend::cynaraCheck(NetherCynaraCheckInfo checkInfo)
 {
+	u_int32_t slot;
+
 	cynaraLastResult = cynara_async_check_cache(cynaraContext,
-												checkInfo.packet.securityContext.c_str(),
+												NetherLabelTable::toString(checkInfo.packet.securityContext).c_str(),
 												"",
-												std::to_string(checkInfo.packet.uid).c_str(),
+												NetherCynaraUser(checkInfo.packet.uid).c_str(),
 												privilegeChain[checkInfo.privilegeId].first.c_str());
+	countCacheResult(cynaraLastResult);
 
-	LOGD("cynara_async_check_cache ctx=" << checkInfo.packet.securityContext.c_str()
+	LOGD("cynara_async_check_cache ctx=" << NetherLabelTable::toString(checkInfo.packet.securityContext).c_str()
 										 << " user="
-										 << std::to_string(checkInfo.packet.uid).c_str()
+										 << NetherCynaraUser(checkInfo.packet.uid).c_str()
 										 << " privilege="
 										 << privilegeChain[checkInfo.privilegeId].first
 										 << " mark="
@@ -126,21 +357,35 @@ bool NetherCynaraBackend::cynaraCheck(NetherCynaraCheckInfo checkInfo)
 		case CYNARA_API_ACCESS_ALLOWED:
 			return (castVerdict(checkInfo.packet,
 								NetherVerdict::allow,
-								privilegeChain[checkInfo.privilegeId].second));
+								privilegeChain[checkInfo.privilegeId].second,
+								checkInfo.answered ? NetherVerdictPath::policy : NetherVerdictPath::cached));
 
 		case CYNARA_API_ACCESS_DENIED:
-			/* We need to copy this into the queue
-				other checks might be needed
-				and this information will be necessary */
-
-			responseQueue[checkInfo.checkId] = checkInfo;
-			return (reEnqueVerdict(checkInfo.checkId));
+			/* other checks might be needed */
+			return (reEnqueVerdict(checkInfo));
 
 		case CYNARA_API_CACHE_MISS:
+			/* the same question is already on it's way to cynara */
+			if((slot = pendingChecks->findInFlight(checkInfo)) != NETHER_CYNARA_NO_SLOT)
+			{
+				LOGD("joined check id=" << pendingChecks->get(slot).checkInfo.checkId << " packetId=" << checkInfo.packet.id);
+				pendingChecks->get(slot).packetIds.push_back(checkInfo.packet.id);
+				checksCoalesced++;
+				return (true);
+			}
+
+			if(pendingChecks->isFull())
+			{
+				LOGW_RATELIMITED("Too many checks waiting for cynara, fall back to another backend");
+				checksRejected++;
+				overloaded = true;
+				return (false);
+			}
+
 			cynaraLastResult = cynara_async_create_request(cynaraContext,
-							   checkInfo.packet.securityContext.c_str(),
+							   NetherLabelTable::toString(checkInfo.packet.securityContext).c_str(),
 							   "",
-							   std::to_string(checkInfo.packet.uid).c_str(),
+							   NetherCynaraUser(checkInfo.packet.uid).c_str(),
 							   privilegeChain[checkInfo.privilegeId].first.c_str(),
 							   &checkInfo.checkId,
 							   &checkCallback,
@@ -148,25 +393,27 @@ bool NetherCynaraBackend::cynaraCheck(NetherCynaraCheckInfo checkInfo)
 
 			if(cynaraLastResult == CYNARA_API_SUCCESS)
 			{
-				responseQueue[checkInfo.checkId] = checkInfo;
+				pendingChecks->add(checkInfo, std::chrono::steady_clock::now() + std::chrono::milliseconds(checkTimeout));
+				countPendingChecks();
+				checksCreated++;
 				return (true);
 			}
 			else
 			{
 				if(cynaraLastResult == CYNARA_API_SERVICE_NOT_AVAILABLE)
 				{
-					LOGW("Cynara offline, fall back to another backend");
+					LOGW_RATELIMITED("Cynara offline, fall back to another backend");
 					return (false);
 				}
 				else
 				{
-					LOGW("Error on cynara request create after CYNARA_API_CACHE_MISS " << cynaraErrorCodeToString(cynaraLastResult));
+					LOGW_RATELIMITED("Error on cynara request create after CYNARA_API_CACHE_MISS " << cynaraErrorCodeToString(cynaraLastResult));
 					return (false);
 				}
 			}
 
 		default:
-			LOGW("Error on cynara request create unhandled result from cynara_async_check_cache "<<cynaraErrorCodeToString(cynaraLastResult));
+			LOGW_RATELIMITED("Error on cynara request create unhandled result from cynara_async_check_cache "<<cynaraErrorCodeToString(cynaraLastResult));
 			return (false);
 	}
 
@@ -176,13 +423,199 @@ bool NetherCynaraBackend::cynaraCheck(NetherCynaraCheckInfo checkInfo)
 bool NetherCynaraBackend::enqueueVerdict(const NetherPacket &packet)
 {
 	LOGD("packet id=" << packet.id);
+	overloaded = false;
+
+	/* remember it for the warm-up after the next start */
+	if(!warmupRecordPath.empty() && seenEntries.size() < NETHER_CYNARA_WARMUP_ENTRIES)
+		seenEntries.insert(((uint64_t)packet.securityContext << 32) | packet.uid);
+
+	if(parallelChain && allPrivilegesToCheck > 1)
+		return (cynaraCheckChain(packet));
+
 	return (cynaraCheck (NetherCynaraCheckInfo(packet, 0)));
 }
 
-bool NetherCynaraBackend::reEnqueVerdict(cynara_check_id checkId)
+bool NetherCynaraBackend::cynaraCheckChain(const NetherPacket &packet)
+{
+	const NetherCynaraCheckKey key { packet.securityContext, packet.uid, 0 };
+	auto chainKey = chainKeys.find(key);
+
+	/* this security context and uid is already being checked */
+	if(chainKey != chainKeys.end())
+	{
+		chains[chainKey->second].packetIds.push_back(packet.id);
+		checksCoalesced++;
+		return (true);
+	}
+
+	if(freeChains.empty() || pendingChecks->getFree() < allPrivilegesToCheck)
+	{
+		LOGW_RATELIMITED("Too many checks waiting for cynara, fall back to another backend");
+		checksRejected++;
+		overloaded = true;
+		return (false);
+	}
+
+	const u_int32_t chainIndex	= freeChains.back();
+	NetherCynaraChain &chain	= chains[chainIndex];
+	freeChains.pop_back();
+
+	chain.key			= key;
+	chain.answers.assign(allPrivilegesToCheck, NetherCynaraAnswer::unknown);
+	chain.slots.assign(allPrivilegesToCheck, NETHER_CYNARA_NO_SLOT);
+	chain.packetIds.assign(1, packet.id);
+	chain.checksWaiting	= 0;
+	chain.resolved		= false;
+	chain.inUse			= true;
+	chainKeys[key]		= chainIndex;
+
+	const std::string &securityContext	= NetherLabelTable::toString(packet.securityContext);
+	const NetherCynaraUser user(packet.uid);
+	const auto deadline					= std::chrono::steady_clock::now() + std::chrono::milliseconds(checkTimeout);
+
+	/* the privileges after the first one that is allowed don't matter */
+	for(u_int32_t privilegeId = 0; privilegeId < allPrivilegesToCheck; privilegeId++)
+	{
+		NetherCynaraCheckInfo checkInfo(packet, privilegeId);
+
+		cynaraLastResult = cynara_async_check_cache(cynaraContext, securityContext.c_str(), "", user.c_str(),
+						   privilegeChain[privilegeId].first.c_str());
+		countCacheResult(cynaraLastResult);
+
+		if(cynaraLastResult == CYNARA_API_ACCESS_ALLOWED)
+		{
+			chain.answers[privilegeId] = NetherCynaraAnswer::allowed;
+			break;
+		}
+
+		if(cynaraLastResult == CYNARA_API_ACCESS_DENIED)
+		{
+			chain.answers[privilegeId] = NetherCynaraAnswer::denied;
+			continue;
+		}
+
+		if(cynaraLastResult == CYNARA_API_CACHE_MISS)
+		{
+			cynaraLastResult = cynara_async_create_request(cynaraContext, securityContext.c_str(), "", user.c_str(),
+							   privilegeChain[privilegeId].first.c_str(),
+							   &checkInfo.checkId,
+							   &checkCallback,
+							   this);
+		}
+
+		if(cynaraLastResult != CYNARA_API_SUCCESS)
+		{
+			LOGW_RATELIMITED("Error on cynara check for privilege chain " << cynaraErrorCodeToString(cynaraLastResult) << ", fall back to another backend");
+
+			/* the checks that were already sent are not needed */
+			chain.packetIds.clear();
+			resolveChain(chainIndex, netherConfig.defaultVerdict, -1, NetherVerdictPath::fallback);
+			releaseChain(chainIndex);
+			return (false);
+		}
+
+		chain.slots[privilegeId] = pendingChecks->add(checkInfo, deadline, chainIndex);
+		chain.checksWaiting++;
+		checksCreated++;
+		countPendingChecks();
+	}
+
+	/* decided right away when the client cache knew all answers */
+	tryResolveChain(chainIndex, NetherVerdictPath::cached);
+	releaseChain(chainIndex);
+	return (true);
+}
+
+void NetherCynaraBackend::setChainAnswer(const u_int32_t chainIndex, const u_int32_t privilegeId, const cynara_async_call_cause cause, const int cynaraResult)
+{
+	NetherCynaraChain &chain = chains[chainIndex];
+
+	chain.slots[privilegeId] = NETHER_CYNARA_NO_SLOT;
+	chain.checksWaiting--;
+
+	if(!chain.resolved)
+	{
+		if(cause == CYNARA_CALL_CAUSE_ANSWER)
+		{
+			chain.answers[privilegeId] = (cynaraResult == CYNARA_API_ACCESS_ALLOWED) ?
+										 NetherCynaraAnswer::allowed : NetherCynaraAnswer::denied;
+			tryResolveChain(chainIndex, NetherVerdictPath::policy);
+		}
+		else
+		{
+			LOGW_RATELIMITED("privilege chain check not answered cause=" << cause << ", using default verdict");
+			resolveChain(chainIndex, netherConfig.defaultVerdict, -1, NetherVerdictPath::fallback);
+		}
+	}
+
+	releaseChain(chainIndex);
+}
+
+void NetherCynaraBackend::tryResolveChain(const u_int32_t chainIndex, const NetherVerdictPath path)
+{
+	NetherCynaraChain &chain = chains[chainIndex];
+
+	/* the chain is in priority order, a privilege decides
+		only when all the ones before it are denied */
+	for(u_int32_t privilegeId = 0; privilegeId < chain.answers.size(); privilegeId++)
+	{
+		if(chain.answers[privilegeId] == NetherCynaraAnswer::unknown)
+			return;
+
+		if(chain.answers[privilegeId] == NetherCynaraAnswer::allowed)
+		{
+			resolveChain(chainIndex, NetherVerdict::allow, privilegeChain[privilegeId].second, path);
+			return;
+		}
+	}
+
+	LOGD("policy exhausted, deny " << chain.packetIds.size() << " packet(s)");
+	resolveChain(chainIndex, NetherVerdict::deny, -1, path);
+}
+
+void NetherCynaraBackend::resolveChain(const u_int32_t chainIndex, const NetherVerdict verdict, const int32_t mark, const NetherVerdictPath path)
 {
-	NetherCynaraCheckInfo checkInfo = responseQueue[checkId];
+	NetherCynaraChain &chain = chains[chainIndex];
 
+	chain.resolved = true;
+	chainKeys.erase(chain.key);
+
+	for(auto packetId : chain.packetIds)
+		castVerdict(packetId, verdict, mark, path);
+
+	chain.packetIds.clear();
+
+	/* nobody else waits for the remaining checks, those answers are not needed */
+	for(u_int32_t privilegeId = 0; privilegeId < chain.slots.size(); privilegeId++)
+	{
+		const u_int32_t slot = chain.slots[privilegeId];
+
+		if(slot == NETHER_CYNARA_NO_SLOT || pendingChecks->get(slot).abandoned)
+			continue;
+
+		checksCancelled++;
+
+		if(!cancelCheck(slot))
+		{
+			chain.slots[privilegeId] = NETHER_CYNARA_NO_SLOT;
+			chain.checksWaiting--;
+		}
+	}
+}
+
+void NetherCynaraBackend::releaseChain(const u_int32_t chainIndex)
+{
+	NetherCynaraChain &chain = chains[chainIndex];
+
+	if(chain.inUse && chain.resolved && chain.checksWaiting == 0)
+	{
+		chain.inUse = false;
+		freeChains.push_back(chainIndex);
+	}
+}
+
+bool NetherCynaraBackend::reEnqueVerdict(NetherCynaraCheckInfo checkInfo)
+{
 	/* We got deny from cynara, we need to check
 		if our internal policy
 		has other entries and try them too */
@@ -194,14 +627,13 @@ bool NetherCynaraBackend::reEnqueVerdict(cynara_check_id checkId)
 	else
 	{
 		LOGD("policy exhausted, deny packet id=" << checkInfo.packet.id);
-		return (castVerdict(checkInfo.packet.id, NetherVerdict::deny));
+		return (castVerdict(checkInfo.packet.id, NetherVerdict::deny, -1,
+							checkInfo.answered ? NetherVerdictPath::policy : NetherVerdictPath::cached));
 	}
 }
 
-void NetherCynaraBackend::setCynaraVerdict(cynara_check_id checkId, int cynaraResult)
+void NetherCynaraBackend::setCynaraVerdict(const NetherCynaraCheckInfo &checkInfo, int cynaraResult)
 {
-	NetherCynaraCheckInfo checkInfo = responseQueue[checkId];
-
 	if(cynaraResult == CYNARA_API_ACCESS_ALLOWED)
 	{
 		castVerdict(checkInfo.packet.id,
@@ -210,9 +642,11 @@ void NetherCynaraBackend::setCynaraVerdict(cynara_check_id checkId, int cynaraRe
 	}
 	else
 	{
-		if (!reEnqueVerdict(checkId))
+		/* no other backend will get this packet now, it can't stay in the queue */
+		if (!reEnqueVerdict(checkInfo))
 		{
-			LOGE("reEnqueueVerdict failed");
+			LOGE_RATELIMITED("reEnqueueVerdict failed, using default verdict");
+			castVerdict(checkInfo.packet.id, netherConfig.defaultVerdict, -1, NetherVerdictPath::fallback);
 		}
 	}
 }
@@ -240,10 +674,109 @@ bool NetherCynaraBackend::processEvents()
 	if(ret == CYNARA_API_SUCCESS)
 		return (true);
 
-	LOGW("cynara_async_process failed " << cynaraErrorCodeToString(ret));
+	LOGW_RATELIMITED("cynara_async_process failed " << cynaraErrorCodeToString(ret));
 	return (false);
 }
 
+unsigned int NetherCynaraBackend::getTimeoutInterval()
+{
+	/* a check can be answered a bit later then it's deadline, but not much */
+	return (std::max(checkTimeout / 4, 10u));
+}
+
+void NetherCynaraBackend::processTimeouts()
+{
+	const auto now = std::chrono::steady_clock::now();
+	u_int32_t slot;
+
+	/* the warm-up waits when the pending table is busy with packets */
+	issueWarmupChecks();
+
+	while((slot = pendingChecks->getExpired(now)) != NETHER_CYNARA_NO_SLOT)
+	{
+		const NetherCynaraCheckInfo &checkInfo = pendingChecks->get(slot).checkInfo;
+
+		/* this cancels all the checks of the chain */
+		if(pendingChecks->get(slot).chain != NETHER_CYNARA_NO_SLOT)
+		{
+			const u_int32_t chainIndex = pendingChecks->get(slot).chain;
+
+			LOGW_RATELIMITED("cynara privilege chain timed out, using default verdict for "
+				 << chains[chainIndex].packetIds.size() << " packet(s)");
+			checkTimeouts++;
+			resolveChain(chainIndex, netherConfig.defaultVerdict, -1, NetherVerdictPath::fallback);
+			releaseChain(chainIndex);
+			continue;
+		}
+
+		LOGW_RATELIMITED("cynara check id=" << checkInfo.checkId << " timed out, using default verdict for "
+			 << pendingChecks->get(slot).packetIds.size() << " packet(s)");
+		checkTimeouts++;
+
+		for(auto packetId : pendingChecks->get(slot).packetIds)
+			castVerdict(packetId, netherConfig.defaultVerdict, -1, NetherVerdictPath::fallback);
+
+		cancelCheck(slot);
+	}
+}
+
+bool NetherCynaraBackend::cancelCheck(const u_int32_t slot)
+{
+	/* the slot stays in use until cynara confirms the cancellation,
+		the check id can't be reused before that */
+	pendingChecks->abandon(slot);
+
+	if((cynaraLastResult = cynara_async_cancel_request(cynaraContext, pendingChecks->get(slot).checkInfo.checkId)) != CYNARA_API_SUCCESS)
+	{
+		LOGW_RATELIMITED("cynara_async_cancel_request failed " << cynaraErrorCodeToString(cynaraLastResult));
+
+		/* there will be no callback for it, the warm-up must not wait for it */
+		if(pendingChecks->get(slot).warmup)
+		{
+			warmupInFlight--;
+			warmupCheckDone();
+		}
+
+		pendingChecks->release(slot);
+		countPendingChecks();
+		return (false);
+	}
+
+	return (true);
+}
+
+void NetherCynaraBackend::countCacheResult(const int result)
+{
+	if(!metrics)
+		return;
+
+	if(result == CYNARA_API_CACHE_MISS)
+		metrics->cynaraCacheMisses.add();
+	else if(result == CYNARA_API_ACCESS_ALLOWED || result == CYNARA_API_ACCESS_DENIED)
+		metrics->cynaraCacheHits.add();
+}
+
+void NetherCynaraBackend::countPendingChecks()
+{
+	if(metrics)
+		metrics->cynaraPendingChecks.set(pendingChecks->getOccupancy());
+}
+
+void NetherCynaraBackend::logStatistics()
+{
+	LOGI("cynara pending checks=" << pendingChecks->getOccupancy()
+		 << " capacity=" << pendingChecks->getCapacity()
+		 << " high watermark=" << pendingChecks->getHighWatermark()
+		 << " timeouts=" << checkTimeouts
+		 << " rejected=" << checksRejected);
+
+	/* how many checks did not need their own round trip to cynara */
+	LOGI("cynara checks created=" << checksCreated
+		 << " coalesced=" << checksCoalesced
+		 << " coalescing ratio=" << (checksCreated + checksCoalesced ? (checksCoalesced * 100) / (checksCreated + checksCoalesced) : 0) << "%"
+		 << " cancelled=" << checksCancelled);
+}
+
 void NetherCynaraBackend::setCacheSize(const size_t newCacheSize)
 {
 	int ret;
@@ -285,7 +818,61 @@ void NetherCynaraBackend::parseBackendArgs()
 			privilegeChain.clear();
 			privilegeChain.push_back (PrivilegePair (valueNamePair[1], -1));
 		}
+
+		if (valueNamePair[0] == "max-pending")
+		{
+			if (stoi (valueNamePair[1]) > 0 && stoi (valueNamePair[1]) <= NETHER_CYNARA_CHECK_IDS)
+				maxPending = stoi (valueNamePair[1]);
+			else
+				LOGW("Invalid max-pending value: " << valueNamePair[1] << " using: " << maxPending);
+		}
+
+		if (valueNamePair[0] == "warmup")
+		{
+			warmupPath = valueNamePair[1];
+		}
+
+		if (valueNamePair[0] == "warmup-record")
+		{
+			warmupRecordPath = valueNamePair[1];
+		}
+
+		if (valueNamePair[0] == "warmup-window")
+		{
+			if (stoi (valueNamePair[1]) > 0)
+				warmupWindow = stoi (valueNamePair[1]);
+			else
+				LOGW("Invalid warmup-window value: " << valueNamePair[1] << " using: " << warmupWindow);
+		}
+
+		if (valueNamePair[0] == "parallel-chain")
+		{
+			parallelChain = (valueNamePair[1] == "yes" || valueNamePair[1] == "1");
+		}
+
+		if (valueNamePair[0] == "timeout")
+		{
+			if (stoi (valueNamePair[1]) > 0)
+				checkTimeout = stoi (valueNamePair[1]);
+			else
+				LOGW("Invalid timeout value: " << valueNamePair[1] << " using: " << checkTimeout);
+		}
+	}
+}
+
+/* Only the privileges asked for are known here, changes made
+	in the Cynara database itself are not part of it */
+uint64_t NetherCynaraBackend::getPolicyGeneration()
+{
+	uint64_t generation = NETHER_FINGERPRINT_SEED;
+
+	for(auto &privilege : privilegeChain)
+	{
+		generation = fingerprint(privilege.first, generation);
+		generation = fingerprint(&privilege.second, sizeof(privilege.second), generation);
 	}
+
+	return (generation);
 }
 
 bool NetherCynaraBackend::parseInternalPolicy(const std::string &policyFile)
@@ -341,4 +928,155 @@ bool NetherCynaraBackend::parseInternalPolicy(const std::string &policyFile)
 	allPrivilegesToCheck = privilegeChain.size();
 	return (true);
 }
+NetherCynaraPendingTable::NetherCynaraPendingTable(const size_t capacity)
+	:	slots(capacity),
+		checkIdSlots(NETHER_CYNARA_CHECK_IDS, NETHER_CYNARA_NO_SLOT),
+		oldest(NETHER_CYNARA_NO_SLOT),
+		newest(NETHER_CYNARA_NO_SLOT),
+		highWatermark(0)
+{
+	freeSlots.reserve(capacity);
+	keySlots.reserve(capacity);
+
+	for(size_t slot = capacity; slot > 0; slot--)
+		freeSlots.push_back(slot - 1);
+}
+
+bool NetherCynaraPendingTable::isFull() const
+{
+	return (freeSlots.empty());
+}
+
+u_int32_t NetherCynaraPendingTable::add(const NetherCynaraCheckInfo &checkInfo, const std::chrono::steady_clock::time_point deadline,
+										const u_int32_t chain)
+{
+	if(freeSlots.empty())
+		return (NETHER_CYNARA_NO_SLOT);
+
+	const u_int32_t slot				= freeSlots.back();
+	NetherCynaraPendingCheck &pending	= slots[slot];
+	freeSlots.pop_back();
+
+	pending.checkInfo	= checkInfo;
+	pending.packetIds.assign(1, checkInfo.packet.id);
+	pending.deadline	= deadline;
+	pending.chain		= chain;
+	pending.warmup		= false;
+	pending.abandoned	= false;
+	pending.previous	= newest;
+	pending.next		= NETHER_CYNARA_NO_SLOT;
+
+	if(newest != NETHER_CYNARA_NO_SLOT)
+		slots[newest].next = slot;
+	else
+		oldest = slot;
+
+	newest								= slot;
+	checkIdSlots[checkInfo.checkId]		= slot;
+
+	/* checks of a chain are joined through the chain */
+	if(chain == NETHER_CYNARA_NO_SLOT)
+		keySlots[checkKey(checkInfo)]	= slot;
+	highWatermark						= std::max(highWatermark, getOccupancy());
+
+	return (slot);
+}
+
+u_int32_t NetherCynaraPendingTable::find(const cynara_check_id checkId) const
+{
+	return (checkIdSlots[checkId]);
+}
+
+NetherCynaraPendingCheck &NetherCynaraPendingTable::get(const u_int32_t slot)
+{
+	return (slots[slot]);
+}
+
+u_int32_t NetherCynaraPendingTable::findInFlight(const NetherCynaraCheckInfo &checkInfo) const
+{
+	auto keySlot = keySlots.find(checkKey(checkInfo));
+
+	if(keySlot == keySlots.end())
+		return (NETHER_CYNARA_NO_SLOT);
+
+	return (keySlot->second);
+}
+
+u_int32_t NetherCynaraPendingTable::getExpired(const std::chrono::steady_clock::time_point now) const
+{
+	if(oldest != NETHER_CYNARA_NO_SLOT && slots[oldest].deadline <= now)
+		return (oldest);
+
+	return (NETHER_CYNARA_NO_SLOT);
+}
+
+void NetherCynaraPendingTable::abandon(const u_int32_t slot)
+{
+	/* nobody may join a check that timed out */
+	unlink(slot);
+	forget(slot);
+	slots[slot].abandoned = true;
+}
+
+void NetherCynaraPendingTable::release(const u_int32_t slot)
+{
+	if(!slots[slot].abandoned)
+	{
+		unlink(slot);
+		forget(slot);
+	}
+
+	checkIdSlots[slots[slot].checkInfo.checkId] = NETHER_CYNARA_NO_SLOT;
+	freeSlots.push_back(slot);
+}
+
+void NetherCynaraPendingTable::unlink(const u_int32_t slot)
+{
+	NetherCynaraPendingCheck &pending = slots[slot];
+
+	if(pending.previous != NETHER_CYNARA_NO_SLOT)
+		slots[pending.previous].next = pending.next;
+	else
+		oldest = pending.next;
+
+	if(pending.next != NETHER_CYNARA_NO_SLOT)
+		slots[pending.next].previous = pending.previous;
+	else
+		newest = pending.previous;
+}
+
+/* A check of a chain shares it's key with the check others joined,
+	so the key is only dropped by the slot it points to */
+void NetherCynaraPendingTable::forget(const u_int32_t slot)
+{
+	auto keySlot = keySlots.find(checkKey(slots[slot].checkInfo));
+
+	if(keySlot != keySlots.end() && keySlot->second == slot)
+		keySlots.erase(keySlot);
+}
+
+NetherCynaraCheckKey NetherCynaraPendingTable::checkKey(const NetherCynaraCheckInfo &checkInfo)
+{
+	return (NetherCynaraCheckKey{checkInfo.packet.securityContext, checkInfo.packet.uid, checkInfo.privilegeId});
+}
+
+size_t NetherCynaraPendingTable::getOccupancy() const
+{
+	return (slots.size() - freeSlots.size());
+}
+
+size_t NetherCynaraPendingTable::getFree() const
+{
+	return (freeSlots.size());
+}
+
+size_t NetherCynaraPendingTable::getCapacity() const
+{
+	return (slots.size());
+}
+
+size_t NetherCynaraPendingTable::getHighWatermark() const
+{
+	return (highWatermark);
+}
 #endif
@@ -0,0 +1,138 @@
+/*
+ *  Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Roman Kubiak (r.kubiak@samsung.com)
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+
+/**
+ * @file
+ * @author  Roman Kubiak (r.kubiak@samsung.com)
+ * @brief   Decision cache in front of the policy backends
+ */
+
+#include "nether_DecisionCache.h"
+
+#include <algorithm>
+
+NetherDecisionCache::NetherDecisionCache(const size_t _maxEntries, const unsigned int _ttlSeconds)
+	:	maxEntries(_maxEntries),
+		ttl(_ttlSeconds),
+		hits(0),
+		misses(0),
+		evictions(0)
+{
+}
+
+bool NetherDecisionCache::lookup(const NetherDecisionKey &key, NetherDecision &decision)
+{
+	auto indexIterator = index.find(key);
+
+	if(indexIterator == index.end())
+	{
+		misses++;
+		return (false);
+	}
+
+	if(indexIterator->second->expires <= std::chrono::steady_clock::now())
+	{
+		entries.erase(indexIterator->second);
+		index.erase(indexIterator);
+		misses++;
+		return (false);
+	}
+
+	/* move it to the front, it's the most recently used now */
+	entries.splice(entries.begin(), entries, indexIterator->second);
+	decision = indexIterator->second->decision;
+	hits++;
+	return (true);
+}
+
+void NetherDecisionCache::insert(const NetherDecisionKey &key, const NetherDecision &decision)
+{
+	insert(key, decision, ttl.count());
+}
+
+/* entries restored from a snapshot keep the time they had left */
+void NetherDecisionCache::insert(const NetherDecisionKey &key, const NetherDecision &decision, const unsigned int secondsLeft)
+{
+	const auto expires = std::chrono::steady_clock::now() + std::min(ttl, std::chrono::seconds(secondsLeft));
+	auto indexIterator = index.find(key);
+
+	if(maxEntries == 0)
+		return;
+
+	if(indexIterator != index.end())
+	{
+		indexIterator->second->decision	= decision;
+		indexIterator->second->expires	= expires;
+		entries.splice(entries.begin(), entries, indexIterator->second);
+		return;
+	}
+
+	if(entries.size() >= maxEntries)
+	{
+		index.erase(entries.back().key);
+		entries.pop_back();
+		evictions++;
+	}
+
+	entries.push_front(CacheEntry{key, decision, expires});
+	index[key] = entries.begin();
+}
+
+/* most recently used first, expired entries are left out */
+void NetherDecisionCache::getEntries(std::vector<NetherDecisionCacheEntry> &cacheEntries) const
+{
+	const auto now = std::chrono::steady_clock::now();
+
+	cacheEntries.clear();
+	cacheEntries.reserve(entries.size());
+
+	for(auto &entry : entries)
+	{
+		if(entry.expires <= now)
+			continue;
+
+		cacheEntries.push_back(NetherDecisionCacheEntry{entry.key, entry.decision,
+							   (unsigned int)std::chrono::duration_cast<std::chrono::seconds>(entry.expires - now).count()});
+	}
+}
+
+void NetherDecisionCache::clear()
+{
+	entries.clear();
+	index.clear();
+}
+
+size_t NetherDecisionCache::getSize() const
+{
+	return (entries.size());
+}
+
+uint64_t NetherDecisionCache::getHits() const
+{
+	return (hits);
+}
+
+uint64_t NetherDecisionCache::getMisses() const
+{
+	return (misses);
+}
+
+uint64_t NetherDecisionCache::getEvictions() const
+{
+	return (evictions);
+}
@@ -0,0 +1,248 @@
+/*
+ *  Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Roman Kubiak (r.kubiak@samsung.com)
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+
+/**
+ * @file
+ * @author  Roman Kubiak (r.kubiak@samsung.com)
+ * @brief   On disk snapshot of the decision cache
+ */
+
+#include "nether_DecisionSnapshot.h"
+#include "nether_Utils.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unordered_map>
+
+/* A durable snapshot is flushed to disk before it replaces the old one.
+	The periodic ones are not, a queue thread would wait for the disk, if
+	one is lost in a crash the checksum does not match and it's ignored */
+bool NetherDecisionSnapshot::write(const std::string &path, const uint64_t policyGeneration, const std::vector<NetherDecisionCacheEntry> &entries,
+								   const bool durable)
+{
+	const std::string temporaryPath = path + ".tmp";
+	std::vector<NetherSnapshotRecord> records;
+	std::unordered_map<NetherLabelId, uint32_t> labelOffsets;
+	std::string labels;
+	NetherSnapshotHeader header;
+	int snapshotDescriptor;
+	bool written;
+
+	records.reserve(entries.size());
+
+	for(auto &entry : entries)
+	{
+		/* it would be expired by the time anyone reads it */
+		if(entry.secondsLeft == 0)
+			continue;
+
+		const std::string &label	= NetherLabelTable::toString(entry.key.securityContext);
+		auto labelOffset			= labelOffsets.find(entry.key.securityContext);
+
+		if(labelOffset == labelOffsets.end())
+		{
+			labelOffset = labelOffsets.emplace(entry.key.securityContext, labels.size()).first;
+			labels.append(label);
+		}
+
+		NetherSnapshotRecord record;
+		memset(&record, 0, sizeof(record));
+		record.labelOffset	= labelOffset->second;
+		record.labelLength	= label.size();
+		record.uid			= entry.key.uid;
+		record.gid			= entry.key.gid;
+		record.mark			= entry.decision.mark;
+		record.secondsLeft	= entry.secondsLeft;
+		record.verdict		= (uint8_t)entry.decision.verdict;
+		records.push_back(record);
+	}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, NETHER_SNAPSHOT_MAGIC, sizeof(header.magic));
+	header.version			= NETHER_SNAPSHOT_VERSION;
+	header.entryCount		= records.size();
+	header.labelsSize		= labels.size();
+	header.policyGeneration	= policyGeneration;
+	header.writtenAt		= time(NULL);
+	header.checksum			= fingerprint(labels.data(), labels.size(),
+									  fingerprint(records.data(), records.size() * sizeof(NetherSnapshotRecord)));
+
+	if((snapshotDescriptor = open(temporaryPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600)) == -1)
+	{
+		LOGW("Failed to create decision snapshot: " << temporaryPath << " " << strerror(errno));
+		return (false);
+	}
+
+	written = writeAll(snapshotDescriptor, &header, sizeof(header)) &&
+			  writeAll(snapshotDescriptor, records.data(), records.size() * sizeof(NetherSnapshotRecord)) &&
+			  writeAll(snapshotDescriptor, labels.data(), labels.size()) &&
+			  (!durable || fsync(snapshotDescriptor) == 0);
+
+	if(close(snapshotDescriptor) != 0)
+		written = false;
+
+	/* readers see either the old or the new snapshot, never a partial one */
+	if(!written || rename(temporaryPath.c_str(), path.c_str()) != 0)
+	{
+		LOGW("Failed to write decision snapshot: " << path << " " << strerror(errno));
+		unlink(temporaryPath.c_str());
+		return (false);
+	}
+
+	LOGD("decision snapshot of " << records.size() << " entries written to: " << path);
+	return (true);
+}
+
+bool NetherDecisionSnapshot::read(const std::string &path, const uint64_t policyGeneration, std::vector<NetherDecisionCacheEntry> &entries)
+{
+	struct stat snapshotStat;
+	const uint8_t *data;
+	int snapshotDescriptor;
+	bool valid;
+
+	entries.clear();
+
+	if((snapshotDescriptor = open(path.c_str(), O_RDONLY | O_CLOEXEC)) == -1)
+	{
+		if(errno == ENOENT)
+			LOGI("No decision snapshot at: " << path);
+		else
+			LOGW("Failed to open decision snapshot: " << path << " " << strerror(errno));
+		return (false);
+	}
+
+	if(fstat(snapshotDescriptor, &snapshotStat) != 0 || (size_t)snapshotStat.st_size < sizeof(NetherSnapshotHeader))
+	{
+		LOGW("Decision snapshot is truncated: " << path);
+		close(snapshotDescriptor);
+		return (false);
+	}
+
+	data = (const uint8_t *)mmap(NULL, snapshotStat.st_size, PROT_READ, MAP_PRIVATE, snapshotDescriptor, 0);
+	close(snapshotDescriptor);
+
+	if(data == MAP_FAILED)
+	{
+		LOGW("Failed to map decision snapshot: " << path << " " << strerror(errno));
+		return (false);
+	}
+
+	if((valid = validate(data, snapshotStat.st_size, policyGeneration)))
+	{
+		const NetherSnapshotHeader *header	= (const NetherSnapshotHeader *)data;
+		const NetherSnapshotRecord *records	= (const NetherSnapshotRecord *)(data + sizeof(NetherSnapshotHeader));
+		const char *labels					= (const char *)(records + header->entryCount);
+		const uint64_t now					= time(NULL);
+		const uint64_t elapsed				= now > header->writtenAt ? now - header->writtenAt : 0;
+
+		entries.reserve(header->entryCount);
+
+		for(uint32_t n = 0; n < header->entryCount; n++)
+		{
+			const NetherSnapshotRecord &record = records[n];
+
+			/* decisions keep expiring while nether is not running */
+			if(record.secondsLeft <= elapsed)
+				continue;
+
+			entries.push_back(NetherDecisionCacheEntry{
+								  NetherDecisionKey{NetherLabelTable::intern(labels + record.labelOffset, record.labelLength), record.uid, record.gid},
+								  NetherDecision{(NetherVerdict)record.verdict, record.mark},
+								  (unsigned int)(record.secondsLeft - elapsed)});
+		}
+	}
+	else
+	{
+		LOGW("Decision snapshot not used: " << path);
+	}
+
+	munmap((void *)data, snapshotStat.st_size);
+	return (valid);
+}
+
+bool NetherDecisionSnapshot::validate(const uint8_t *data, const size_t size, const uint64_t policyGeneration)
+{
+	const NetherSnapshotHeader *header	= (const NetherSnapshotHeader *)data;
+	const NetherSnapshotRecord *records	= (const NetherSnapshotRecord *)(data + sizeof(NetherSnapshotHeader));
+	const size_t recordsSize			= (size_t)header->entryCount * sizeof(NetherSnapshotRecord);
+
+	if(memcmp(header->magic, NETHER_SNAPSHOT_MAGIC, sizeof(header->magic)) != 0)
+	{
+		LOGW("Decision snapshot has no valid header");
+		return (false);
+	}
+
+	if(header->version != NETHER_SNAPSHOT_VERSION)
+	{
+		LOGI("Decision snapshot version " << header->version << " is not supported");
+		return (false);
+	}
+
+	if(size != sizeof(NetherSnapshotHeader) + recordsSize + header->labelsSize)
+	{
+		LOGW("Decision snapshot size does not match it's header");
+		return (false);
+	}
+
+	if(header->checksum != fingerprint(data + sizeof(NetherSnapshotHeader) + recordsSize, header->labelsSize,
+									   fingerprint(records, recordsSize)))
+	{
+		LOGW("Decision snapshot checksum mismatch");
+		return (false);
+	}
+
+	/* the policy changed since it was written, the decisions might be wrong */
+	if(header->policyGeneration != policyGeneration)
+	{
+		LOGI("Decision snapshot was made with a different policy");
+		return (false);
+	}
+
+	for(uint32_t n = 0; n < header->entryCount; n++)
+	{
+		if((uint64_t)records[n].labelOffset + records[n].labelLength > header->labelsSize ||
+				records[n].verdict >= (uint8_t)NetherVerdict::noVerdictYet)
+		{
+			LOGW("Decision snapshot record " << n << " is invalid");
+			return (false);
+		}
+	}
+
+	return (true);
+}
+
+bool NetherDecisionSnapshot::writeAll(const int descriptor, const void *data, const size_t size)
+{
+	const uint8_t *bytes	= (const uint8_t *)data;
+	size_t bytesWritten		= 0;
+
+	while(bytesWritten < size)
+	{
+		const ssize_t result = ::write(descriptor, bytes + bytesWritten, size - bytesWritten);
+
+		if(result < 0 && errno == EINTR)
+			continue;
+
+		if(result <= 0)
+			return (false);
+
+		bytesWritten += result;
+	}
+
+	return (true);
+}
@@ -0,0 +1,199 @@
+/*
+ *  Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Roman Kubiak (r.kubiak@samsung.com)
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+
+/**
+ * @file
+ * @author  Roman Kubiak (r.kubiak@samsung.com)
+ * @brief   epoll based event loop for nether
+ */
+
+#include "nether_EventLoop.h"
+
+#include <sys/timerfd.h>
+
+NetherEventLoop::NetherEventLoop()
+	: epollDescriptor(-1)
+{
+}
+
+NetherEventLoop::~NetherEventLoop()
+{
+	for(auto &timerDescriptor : timerDescriptors)
+		close(timerDescriptor);
+
+	if(epollDescriptor != -1)
+		close(epollDescriptor);
+}
+
+bool NetherEventLoop::initialize()
+{
+	if((epollDescriptor = epoll_create1(EPOLL_CLOEXEC)) == -1)
+	{
+		LOGE("Failed to create epoll descriptor: " << strerror(errno));
+		return (false);
+	}
+
+	return (true);
+}
+
+bool NetherEventLoop::addDescriptor(const int descriptor, const uint32_t events, const std::string &name, const int budget, NetherEventHandler handler)
+{
+	struct epoll_event event;
+
+	memset(&event, 0, sizeof(event));
+	event.events	= events;
+	event.data.fd	= descriptor;
+
+	if(epoll_ctl(epollDescriptor, EPOLL_CTL_ADD, descriptor, &event) == -1)
+	{
+		LOGE("Failed to add descriptor=" << descriptor << " to epoll: " << strerror(errno));
+		return (false);
+	}
+
+	/* statistics are kept per name, they survive the descriptor
+		being replaced (like when the backend reconnects) */
+	eventSources[descriptor] = NetherEventSource { budget, &eventStatistics[name], handler };
+	return (true);
+}
+
+bool NetherEventLoop::modifyDescriptor(const int descriptor, const uint32_t events)
+{
+	struct epoll_event event;
+
+	memset(&event, 0, sizeof(event));
+	event.events	= events;
+	event.data.fd	= descriptor;
+
+	/* a closed descriptor is gone from the epoll set, when it's number
+		comes back for a new one the caller adds that one instead */
+	if(epoll_ctl(epollDescriptor, EPOLL_CTL_MOD, descriptor, &event) == -1)
+	{
+		if(errno == ENOENT)
+			LOGD("descriptor=" << descriptor << " is not in epoll anymore");
+		else
+			LOGE("Failed to modify descriptor=" << descriptor << " in epoll: " << strerror(errno));
+
+		return (false);
+	}
+
+	return (true);
+}
+
+bool NetherEventLoop::removeDescriptor(const int descriptor)
+{
+	eventSources.erase(descriptor);
+
+	/* the descriptor might be closed already, in that case
+		the kernel has already removed it from the epoll set */
+	if(epoll_ctl(epollDescriptor, EPOLL_CTL_DEL, descriptor, NULL) == -1 && errno != EBADF && errno != ENOENT)
+	{
+		LOGW("Failed to remove descriptor=" << descriptor << " from epoll: " << strerror(errno));
+		return (false);
+	}
+
+	return (true);
+}
+
+int NetherEventLoop::addTimer(const std::string &name, const unsigned int intervalMs, NetherTimerHandler handler)
+{
+	struct itimerspec timerSpecification;
+	int timerDescriptor;
+
+	if((timerDescriptor = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) == -1)
+	{
+		LOGE("Failed to create timer descriptor: " << strerror(errno));
+		return (-1);
+	}
+
+	timerSpecification.it_interval.tv_sec	= intervalMs / 1000;
+	timerSpecification.it_interval.tv_nsec	= (intervalMs % 1000) * 1000000;
+	timerSpecification.it_value				= timerSpecification.it_interval;
+
+	if(timerfd_settime(timerDescriptor, 0, &timerSpecification, NULL) == -1)
+	{
+		LOGE("Failed to arm timer descriptor: " << strerror(errno));
+		close(timerDescriptor);
+		return (-1);
+	}
+
+	if(!addDescriptor(timerDescriptor, EPOLLIN, name, 1, [timerDescriptor, handler](const uint32_t, const int)
+		{
+			uint64_t expirations;
+
+			if(read(timerDescriptor, &expirations, sizeof(expirations)) == sizeof(expirations))
+				handler();
+
+			return (1);
+		}))
+	{
+		close(timerDescriptor);
+		return (-1);
+	}
+
+	timerDescriptors.push_back(timerDescriptor);
+	return (timerDescriptor);
+}
+
+bool NetherEventLoop::dispatch(const int timeoutMs)
+{
+	int readyCount;
+
+	if((readyCount = epoll_wait(epollDescriptor, readyEvents, NETHER_MAX_EPOLL_EVENTS, timeoutMs)) == -1)
+	{
+		if(errno == EINTR)
+			return (true);
+
+		LOGE("epoll_wait error " << strerror(errno));
+		return (false);
+	}
+
+	/* Every ready source gets it's own budget in each iteration, a source
+		that used all of it stays readable (epoll is level triggered) and
+		gets another share in the next iteration, after all other ready
+		sources got theirs. This way no source can starve the others */
+	for(int event = 0; event < readyCount; event++)
+	{
+		/* a handler that ran before might have removed this descriptor */
+		auto sourceIterator = eventSources.find(readyEvents[event].data.fd);
+
+		if(sourceIterator == eventSources.end())
+			continue;
+
+		/* copy the handler, it might remove itself while running */
+		NetherEventHandler handler					= sourceIterator->second.handler;
+		NetherEventSourceStatistics *statistics	= sourceIterator->second.statistics;
+		const int budget							= sourceIterator->second.budget;
+		const int unitsHandled						= handler(readyEvents[event].events, budget);
+
+		if(unitsHandled < 0)
+			return (false);
+
+		statistics->wakeups++;
+		statistics->unitsHandled += unitsHandled;
+
+		if(budget > 1 && unitsHandled >= budget)
+			statistics->budgetExhausted++;
+	}
+
+	return (true);
+}
+
+const std::map<std::string, NetherEventSourceStatistics> &NetherEventLoop::getStatistics() const
+{
+	return (eventStatistics);
+}
@@ -77,22 +77,83 @@ bool NetherFileBackend::reload()
 
 bool NetherFileBackend::enqueueVerdict(const NetherPacket &packet)
 {
-	for(auto &policyIterator : policy)
+	/* The first entry in the file that matches decides, so look in every
+		tier that can match and take the lowest position */
+	size_t firstMatch = policy.size();
+	auto contextIterator = contextIndex.find(packet.securityContext);
+
+	lookupPolicyIndex(anyContextIndex, packet, firstMatch);
+
+	if(contextIterator != contextIndex.end())
+		lookupPolicyIndex(contextIterator->second, packet, firstMatch);
+
+	if(firstMatch < policy.size())
 	{
-		if(
-			((policyIterator.uid == packet.uid) || policyIterator.uid == NETHER_INVALID_UID) &&
-			((policyIterator.gid == packet.gid) || policyIterator.gid == NETHER_INVALID_GID) &&
-			((policyIterator.securityContext == packet.securityContext) || policyIterator.securityContext.empty())
-		)
-		{
-			LOGD("policy match " << dumpPolicyEntry(policyIterator));
-			return (castVerdict(packet, policyIterator.verdict));
-		}
+		LOGD("policy match " << dumpPolicyEntry(policy[firstMatch]));
+		return (castVerdict(packet, policy[firstMatch].verdict));
 	}
 
 	return (castVerdict(packet, netherConfig.defaultVerdict));
 }
 
+uint64_t NetherFileBackend::getPolicyGeneration()
+{
+	uint64_t generation = NETHER_FINGERPRINT_SEED;
+
+	for(auto &entry : policy)
+	{
+		generation = fingerprint(&entry.uid, sizeof(entry.uid), generation);
+		generation = fingerprint(&entry.gid, sizeof(entry.gid), generation);
+		generation = fingerprint(entry.securityContext, generation);
+		generation = fingerprint(&entry.verdict, sizeof(entry.verdict), generation);
+	}
+
+	return (generation);
+}
+
+void NetherFileBackend::lookupPolicyIndex(const PolicyIndex &index, const NetherPacket &packet, size_t &firstMatch) const
+{
+	for(size_t tier = 0; tier < NETHER_POLICY_INDEX_TIERS; tier++)
+	{
+		if(index.tiers[tier].empty())
+			continue;
+
+		auto entryIterator = index.tiers[tier].find(policyIndexKey(
+								 (tier & 0x1) ? NETHER_INVALID_UID : packet.uid,
+								 (tier & 0x2) ? NETHER_INVALID_GID : packet.gid));
+
+		if(entryIterator != index.tiers[tier].end() && entryIterator->second < firstMatch)
+			firstMatch = entryIterator->second;
+	}
+}
+
+void NetherFileBackend::buildPolicyIndex()
+{
+	contextIndex.clear();
+	anyContextIndex = PolicyIndex();
+
+	for(size_t position = 0; position < policy.size(); position++)
+	{
+		const PolicyEntry &entry	= policy[position];
+		PolicyIndex &index			= entry.securityContext.empty() ?
+										anyContextIndex : contextIndex[NetherLabelTable::intern(entry.securityContext)];
+
+		/* emplace() keeps the existing position, the first entry wins */
+		index.tiers[policyIndexTier(entry.uid == NETHER_INVALID_UID, entry.gid == NETHER_INVALID_GID)].emplace(
+			policyIndexKey(entry.uid, entry.gid), position);
+	}
+}
+
+size_t NetherFileBackend::policyIndexTier(const bool uidWildcard, const bool gidWildcard)
+{
+	return ((uidWildcard ? 0x1 : 0) | (gidWildcard ? 0x2 : 0));
+}
+
+uint64_t NetherFileBackend::policyIndexKey(const uid_t uid, const gid_t gid)
+{
+	return (((uint64_t)uid << 32) | (uint32_t)gid);
+}
+
 bool NetherFileBackend::parsePolicyFile(std::ifstream &policyFile)
 {
 	std::string line;
@@ -128,6 +189,7 @@ bool NetherFileBackend::parsePolicyFile(std::ifstream &policyFile)
 		}
 	}
 
+	buildPolicyIndex();
 	return (true);
 }
 
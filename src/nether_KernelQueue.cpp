@@ -0,0 +1,126 @@
+/*
+ *  Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Roman Kubiak (r.kubiak@samsung.com)
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+
+/**
+ * @file
+ * @author  Roman Kubiak (r.kubiak@samsung.com)
+ * @brief   Kernel side statistics of the netfilter queues
+ */
+
+#include "nether_KernelQueue.h"
+
+#include <fstream>
+#include <inttypes.h>
+
+NetherKernelQueue::NetherKernelQueue(const std::vector<int> &queueNumbers, const uint32_t _depthWarning, const std::string &_path)
+	: depthWarning(_depthWarning), path(_path), readFailed(false)
+{
+	for(auto queueNumber : queueNumbers)
+	{
+		NetherKernelQueueStatus status;
+		memset(&status, 0, sizeof(status));
+		status.queueNumber = queueNumber;
+		queues.push_back(status);
+	}
+}
+
+void NetherKernelQueue::setDepthHandler(NetherQueueDepthHandler handler)
+{
+	depthHandler = handler;
+}
+
+const std::vector<NetherKernelQueueStatus> &NetherKernelQueue::getStatus() const
+{
+	return (queues);
+}
+
+/* The kernel writes every queue as:
+	queue_num peer_portid queue_total copy_mode copy_range queue_dropped user_dropped id_sequence 1 */
+bool NetherKernelQueue::parse(const std::string &line, NetherKernelQueueStatus &status)
+{
+	memset(&status, 0, sizeof(status));
+
+	return (sscanf(line.c_str(), "%" SCNu32 " %" SCNu32 " %" SCNu32 " %" SCNu32 " %" SCNu32 " %" SCNu32 " %" SCNu32 " %" SCNu32,
+				   &status.queueNumber, &status.portId, &status.pending, &status.copyMode, &status.copyRange,
+				   &status.queueDropped, &status.userDropped, &status.idSequence) == 8);
+}
+
+bool NetherKernelQueue::collect()
+{
+	std::ifstream queueStream(path);
+	std::string line;
+
+	if(!queueStream)
+	{
+		/* the file is there once the nfnetlink_queue module is loaded */
+		if(!readFailed)
+			LOGW("Can't read kernel queue statistics from: " << path);
+		readFailed = true;
+		return (false);
+	}
+
+	readFailed = false;
+
+	while(std::getline(queueStream, line))
+	{
+		NetherKernelQueueStatus newStatus;
+
+		if(!parse(line, newStatus))
+		{
+			LOGD("Malformed kernel queue statistics line: " << line);
+			continue;
+		}
+
+		for(auto &status : queues)
+		{
+			if(status.queueNumber == newStatus.queueNumber)
+				update(status, newStatus);
+		}
+	}
+
+	return (true);
+}
+
+void NetherKernelQueue::update(NetherKernelQueueStatus &status, const NetherKernelQueueStatus &newStatus)
+{
+	/* the counters start at 0 again when the queue is bound again */
+	if(status.seen && newStatus.queueDropped > status.queueDropped)
+		LOGW_RATELIMITED("Kernel dropped " << newStatus.queueDropped - status.queueDropped
+						 << " packet(s) of queue " << status.queueNumber << ", the queue is full");
+
+	if(status.seen && newStatus.userDropped > status.userDropped)
+		LOGW_RATELIMITED("Kernel dropped " << newStatus.userDropped - status.userDropped
+						 << " packet(s) of queue " << status.queueNumber << ", the netlink socket buffer is full");
+
+	status.portId		= newStatus.portId;
+	status.pending		= newStatus.pending;
+	status.copyMode		= newStatus.copyMode;
+	status.copyRange	= newStatus.copyRange;
+	status.queueDropped	= newStatus.queueDropped;
+	status.userDropped	= newStatus.userDropped;
+	status.idSequence	= newStatus.idSequence;
+	status.seen			= true;
+
+	if(depthWarning == 0 || (status.pending >= depthWarning) == status.overThreshold)
+		return;
+
+	status.overThreshold = !status.overThreshold;
+
+	if(depthHandler)
+		depthHandler(status);
+}
@@ -0,0 +1,171 @@
+/*
+ *  Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Roman Kubiak (r.kubiak@samsung.com)
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+
+/**
+ * @file
+ * @author  Roman Kubiak (r.kubiak@samsung.com)
+ * @brief   Security context (label) intern table
+ */
+
+#include "nether_LabelTable.h"
+
+#include <cstring>
+
+thread_local NetherLabelTable::NetherLabelCacheEntry NetherLabelTable::internCache[NETHER_LABEL_CACHE_SLOTS];
+thread_local std::vector<const std::string *> NetherLabelTable::labelCache;
+
+NetherLabelTable::NetherLabelTable()
+	:	slots(NETHER_LABEL_TABLE_SLOTS, NETHER_NO_LABEL)
+{
+	/* id 0 is the packet without a security context */
+	labels.push_back(std::string());
+	labelHashes.push_back(0);
+}
+
+NetherLabelTable &NetherLabelTable::instance()
+{
+	static NetherLabelTable labelTable;
+	return (labelTable);
+}
+
+NetherLabelId NetherLabelTable::intern(const char *label, const size_t length)
+{
+	if(length == 0)
+		return (NETHER_NO_LABEL);
+
+	const uint32_t hash				= hashLabel(label, length);
+	NetherLabelCacheEntry &cached	= internCache[hash & (NETHER_LABEL_CACHE_SLOTS - 1)];
+
+	if(cached.label &&
+			cached.hash == hash &&
+			cached.label->size() == length &&
+			memcmp(cached.label->data(), label, length) == 0)
+		return (cached.labelId);
+
+	NetherLabelTable &table	= instance();
+	std::lock_guard<std::mutex> lock(table.tableMutex);
+	const NetherLabelId labelId	= table.find(label, length, hash);
+
+	cached.label	= &table.labels[labelId];
+	cached.hash		= hash;
+	cached.labelId	= labelId;
+
+	return (labelId);
+}
+
+NetherLabelId NetherLabelTable::intern(const std::string &label)
+{
+	return (intern(label.data(), label.size()));
+}
+
+const std::string &NetherLabelTable::toString(const NetherLabelId labelId)
+{
+	if(labelId < labelCache.size() && labelCache[labelId])
+		return (*labelCache[labelId]);
+
+	NetherLabelTable &table = instance();
+	std::lock_guard<std::mutex> lock(table.tableMutex);
+
+	if(labelId >= table.labels.size())
+		return (table.labels[NETHER_NO_LABEL]);
+
+	if(labelId >= labelCache.size())
+		labelCache.resize(table.labels.size(), nullptr);
+
+	labelCache[labelId] = &table.labels[labelId];
+	return (table.labels[labelId]);
+}
+
+size_t NetherLabelTable::getSize()
+{
+	NetherLabelTable &table = instance();
+	std::lock_guard<std::mutex> lock(table.tableMutex);
+
+	return (table.labels.size() - 1);
+}
+
+/* FNV-1a */
+uint32_t NetherLabelTable::hashLabel(const char *label, const size_t length)
+{
+	uint32_t hash = 2166136261u;
+
+	for(size_t n = 0; n < length; n++)
+	{
+		hash ^= (uint8_t)label[n];
+		hash *= 16777619u;
+	}
+
+	return (hash);
+}
+
+/* called with the table locked */
+NetherLabelId NetherLabelTable::find(const char *label, const size_t length, const uint32_t hash)
+{
+	const size_t mask = slots.size() - 1;
+
+	for(size_t slot = hash & mask; slots[slot] != NETHER_NO_LABEL; slot = (slot + 1) & mask)
+	{
+		const NetherLabelId labelId		= slots[slot];
+		const std::string &candidate	= labels[labelId];
+
+		if(labelHashes[labelId] == hash &&
+				candidate.size() == length &&
+				memcmp(candidate.data(), label, length) == 0)
+			return (labelId);
+	}
+
+	return (insert(label, length, hash));
+}
+
+NetherLabelId NetherLabelTable::insert(const char *label, const size_t length, const uint32_t hash)
+{
+	const NetherLabelId labelId = labels.size();
+
+	labels.push_back(std::string(label, length));
+	labelHashes.push_back(hash);
+
+	/* keep the table at most half full */
+	if(labels.size() * 2 > slots.size())
+		grow();
+	else
+	{
+		size_t slot = hash & (slots.size() - 1);
+
+		while(slots[slot] != NETHER_NO_LABEL)
+			slot = (slot + 1) & (slots.size() - 1);
+
+		slots[slot] = labelId;
+	}
+
+	return (labelId);
+}
+
+void NetherLabelTable::grow()
+{
+	slots.assign(slots.size() * 2, NETHER_NO_LABEL);
+
+	for(NetherLabelId labelId = 1; labelId < labels.size(); labelId++)
+	{
+		size_t slot = labelHashes[labelId] & (slots.size() - 1);
+
+		while(slots[slot] != NETHER_NO_LABEL)
+			slot = (slot + 1) & (slots.size() - 1);
+
+		slots[slot] = labelId;
+	}
+}
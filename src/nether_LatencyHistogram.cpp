@@ -0,0 +1,169 @@
+/*
+ *  Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Roman Kubiak (r.kubiak@samsung.com)
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+
+/**
+ * @file
+ * @author  Roman Kubiak (r.kubiak@samsung.com)
+ * @brief   Packet to verdict latency histograms
+ */
+
+#include "nether_LatencyHistogram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+NetherLatencyHistogram::NetherLatencyHistogram()
+	: count(0), sum(0)
+{
+	for(auto &bucket : buckets)
+		bucket.store(0, std::memory_order_relaxed);
+}
+
+void NetherLatencyHistogram::add(const NetherLatencyHistogram &other)
+{
+	for(uint32_t bucket = 0; bucket < NETHER_HISTOGRAM_BUCKETS; bucket++)
+		buckets[bucket].fetch_add(other.buckets[bucket].load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+	count.fetch_add(other.count.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	sum.fetch_add(other.sum.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+uint64_t NetherLatencyHistogram::getCount() const
+{
+	return (count.load(std::memory_order_relaxed));
+}
+
+uint64_t NetherLatencyHistogram::getSum() const
+{
+	return (sum.load(std::memory_order_relaxed));
+}
+
+uint64_t NetherLatencyHistogram::getMean() const
+{
+	const uint64_t values = getCount();
+
+	return (values ? sum.load(std::memory_order_relaxed) / values : 0);
+}
+
+/* The highest value of the bucket the percentile falls in, so the
+	result is never lower than the real one */
+uint64_t NetherLatencyHistogram::getPercentile(const double percentile) const
+{
+	const uint64_t values	= getCount();
+	const uint64_t rank		= std::max<uint64_t>(1, (uint64_t)std::ceil(values * percentile / 100.0));
+	uint64_t seen			= 0;
+
+	if(values == 0)
+		return (0);
+
+	for(uint32_t bucket = 0; bucket < NETHER_HISTOGRAM_BUCKETS; bucket++)
+	{
+		seen += buckets[bucket].load(std::memory_order_relaxed);
+
+		if(seen >= rank)
+			return (getBucketLimit(bucket));
+	}
+
+	/* the writer was adding values while we counted */
+	return (getBucketLimit(NETHER_HISTOGRAM_BUCKETS - 1));
+}
+
+std::string NetherLatencyHistogram::toString() const
+{
+	std::stringstream stream;
+
+	stream << std::fixed << std::setprecision(1)
+		   << "packets=" << getCount()
+		   << " mean=" << getMean() / 1000.0 << "us"
+		   << " p50=" << getPercentile(50) / 1000.0 << "us"
+		   << " p99=" << getPercentile(99) / 1000.0 << "us"
+		   << " p99.9=" << getPercentile(99.9) / 1000.0 << "us";
+
+	return (stream.str());
+}
+
+uint64_t NetherLatencyHistogram::getBucketLimit(const uint32_t bucket)
+{
+	if(bucket < NETHER_HISTOGRAM_SUB_BUCKETS)
+		return (bucket);
+
+	const uint32_t shift	= bucket / NETHER_HISTOGRAM_SUB_BUCKETS - 1;
+	const uint64_t lowest	= (uint64_t)(NETHER_HISTOGRAM_SUB_BUCKETS + bucket % NETHER_HISTOGRAM_SUB_BUCKETS) << shift;
+
+	return (lowest + (((uint64_t)1 << shift) - 1));
+}
+
+NetherPacketLatency::NetherPacketLatency()
+	: ring(NETHER_LATENCY_RING_SIZE, NetherLatencySlot{0, 0, NetherLatencySource::fallback, false}),
+	  untracked(0)
+{
+}
+
+NetherLatencySource NetherPacketLatency::getSource(const NetherPolicyBackendType backendType)
+{
+	switch(backendType)
+	{
+		case NetherPolicyBackendType::cynaraBackend:
+#ifdef HAVE_CYNARA
+			return (NetherLatencySource::cynara);
+#else
+			return (NetherLatencySource::fallback);
+#endif
+		case NetherPolicyBackendType::fileBackend:
+			return (NetherLatencySource::file);
+		case NetherPolicyBackendType::dummyBackend:
+		default:
+			return (NetherLatencySource::fallback);
+	}
+}
+
+std::string NetherPacketLatency::sourceToString(const NetherLatencySource source)
+{
+	switch(source)
+	{
+		case NetherLatencySource::decisionCache:
+			return ("decision-cache");
+		case NetherLatencySource::cynaraCache:
+			return ("cynara-cache");
+		case NetherLatencySource::cynara:
+			return ("cynara");
+		case NetherLatencySource::file:
+			return ("file");
+		case NetherLatencySource::fallback:
+		default:
+			return ("fallback");
+	}
+}
+
+const NetherLatencyHistogram &NetherPacketLatency::getHistogram(const NetherLatencySource source, const NetherVerdict verdict) const
+{
+	return (histograms[(size_t)source][(size_t)verdict]);
+}
+
+void NetherPacketLatency::getTotal(NetherLatencyHistogram &total) const
+{
+	for(auto &sourceHistograms : histograms)
+		for(auto &histogram : sourceHistograms)
+			total.add(histogram);
+}
+
+uint64_t NetherPacketLatency::getUntracked() const
+{
+	return (untracked.load(std::memory_order_relaxed));
+}
@@ -26,10 +26,40 @@
 #include "nether_Utils.h"
 #include "nether_Manager.h"
 #include "nether_Daemon.h"
+#include "logger/backend-async.hpp"
 
 using namespace std;
+
+enum NetherLongOption
+{
+	receiveBatchOption = 0x100,
+	netlinkBudgetOption,
+	backendBudgetOption,
+	queuesOption,
+	markAllowOption,
+	statisticsIntervalOption,
+	decisionCacheSizeOption,
+	decisionCacheTtlOption,
+	decisionSnapshotOption,
+	decisionSnapshotIntervalOption,
+	hedgeDelayOption,
+	breakerThresholdOption,
+	breakerOpenTimeOption,
+	logQueueOption,
+	logQueueOverflowOption,
+	logRotateSizeOption,
+	logRotateCountOption,
+	metricsSocketOption,
+	kernelQueueIntervalOption,
+	queueDepthWarningOption,
+	queueMaxLengthOption,
+	netlinkBufferOption
+};
+
 void showHelp(char *arg);
 void cleanupAndExit();
+logger::LogBackend *createLogBackend(const NetherConfig &netherConfig);
+void startAsyncLogging(const NetherConfig &netherConfig);
 
 int main(int argc, char *argv[])
 {
@@ -46,6 +76,11 @@ int main(int argc, char *argv[])
 		{"copy-packets",			no_argument,		&netherConfig.copyPackets,		0},
 		{"interface-info",			no_argument,		&netherConfig.interfaceInfo,	0},
 		{"relaxed",					no_argument,		&netherConfig.relaxed,			0},
+		{"batch-verdicts",			no_argument,		&netherConfig.batchVerdicts,	1},
+		{"pin-queues",				no_argument,		&netherConfig.pinQueues,		1},
+		{"connmark",				no_argument,		&netherConfig.connmarkVerdicts,	1},
+		{"fail-open",				no_argument,		&netherConfig.failOpen,			1},
+		{"no-enobufs",				no_argument,		&netherConfig.noEnobufs,		1},
 		{"log",                     required_argument,  0,								'l'},
 		{"log-args",                required_argument,  0,								'L'},
 		{"default-verdict",         required_argument,  0,								'V'},
@@ -56,8 +91,30 @@ int main(int argc, char *argv[])
 		{"queue-num",               required_argument,  0,								'q'},
 		{"mark-deny",               required_argument,  0,								'm'},
 		{"mark-allow-log",          required_argument,  0,								'M'},
+		{"mark-allow",				required_argument,	0,								markAllowOption},
 		{"rules-path",              required_argument,  0,								'r'},
 		{"iptables-restore-path",   required_argument,  0,								'i'},
+		{"queues",					required_argument,	0,								queuesOption},
+		{"receive-batch",			required_argument,	0,								receiveBatchOption},
+		{"netlink-budget",			required_argument,	0,								netlinkBudgetOption},
+		{"backend-budget",			required_argument,	0,								backendBudgetOption},
+		{"statistics-interval",		required_argument,	0,								statisticsIntervalOption},
+		{"decision-cache-size",		required_argument,	0,								decisionCacheSizeOption},
+		{"decision-cache-ttl",		required_argument,	0,								decisionCacheTtlOption},
+		{"decision-snapshot",		required_argument,	0,								decisionSnapshotOption},
+		{"decision-snapshot-interval",	required_argument,	0,							decisionSnapshotIntervalOption},
+		{"hedge-delay",				required_argument,	0,								hedgeDelayOption},
+		{"breaker-threshold",		required_argument,	0,								breakerThresholdOption},
+		{"breaker-open-time",		required_argument,	0,								breakerOpenTimeOption},
+		{"log-queue",				required_argument,	0,								logQueueOption},
+		{"log-queue-overflow",		required_argument,	0,								logQueueOverflowOption},
+		{"log-rotate-size",			required_argument,	0,								logRotateSizeOption},
+		{"log-rotate-count",		required_argument,	0,								logRotateCountOption},
+		{"metrics-socket",			required_argument,	0,								metricsSocketOption},
+		{"kernel-queue-interval",	required_argument,	0,								kernelQueueIntervalOption},
+		{"queue-depth-warning",		required_argument,	0,								queueDepthWarningOption},
+		{"queue-maxlen",			required_argument,	0,								queueMaxLengthOption},
+		{"netlink-buffer",			required_argument,	0,								netlinkBufferOption},
 		{"help",                    no_argument,        0,								'h'},
 		{0, 0, 0, 0}
 	};
@@ -154,6 +211,15 @@ int main(int argc, char *argv[])
 				netherConfig.markAllowAndLog        = atoi(optarg);
 				break;
 
+			case markAllowOption:
+				if(atoi(optarg) <= 0 || atoi(optarg) >= 255)
+				{
+					cerr << "Connection mark for ALLOW is invalid (must be > 0 and < 255): " << atoi(optarg);
+					exit(1);
+				}
+				netherConfig.markAllow				= atoi(optarg);
+				break;
+
 			case 'r':
 				netherConfig.rulesPath              = optarg;
 				break;
@@ -162,54 +228,247 @@ int main(int argc, char *argv[])
 				netherConfig.iptablesRestorePath    = optarg;
 				break;
 
+			case queuesOption:
+				netherConfig.queueNumbers.clear();
+				if(!parseQueueNumbers(optarg, netherConfig.queueNumbers))
+				{
+					cerr << "Queue numbers are invalid (must be a list of numbers or ranges >= 0 and < 65535): " << optarg;
+					exit(1);
+				}
+				netherConfig.queueNumber			= netherConfig.queueNumbers[0];
+				if(netherConfig.queueNumbers.size() == 1)
+					netherConfig.queueNumbers.clear();
+				break;
+
+			case receiveBatchOption:
+				if(atoi(optarg) < 0 || atoi(optarg) > NETHER_RECEIVE_BATCH_MAX)
+				{
+					cerr << "Receive batch size is invalid (must be >= 0 and <= " << NETHER_RECEIVE_BATCH_MAX << "): " << atoi(optarg);
+					exit(1);
+				}
+				netherConfig.receiveBatchSize		= atoi(optarg);
+				break;
+
+			case netlinkBudgetOption:
+				if(atoi(optarg) <= 0)
+				{
+					cerr << "Netlink budget is invalid (must be > 0): " << atoi(optarg);
+					exit(1);
+				}
+				netherConfig.netlinkBudget			= atoi(optarg);
+				break;
+
+			case backendBudgetOption:
+				if(atoi(optarg) <= 0)
+				{
+					cerr << "Backend budget is invalid (must be > 0): " << atoi(optarg);
+					exit(1);
+				}
+				netherConfig.backendBudget			= atoi(optarg);
+				break;
+
+			case statisticsIntervalOption:
+				if(atoi(optarg) < 0)
+				{
+					cerr << "Statistics interval is invalid (must be >= 0): " << atoi(optarg);
+					exit(1);
+				}
+				netherConfig.statisticsInterval		= atoi(optarg);
+				break;
+
+			case decisionCacheSizeOption:
+				if(atoi(optarg) < 0)
+				{
+					cerr << "Decision cache size is invalid (must be >= 0): " << atoi(optarg);
+					exit(1);
+				}
+				netherConfig.decisionCacheSize		= atoi(optarg);
+				break;
+
+			case decisionCacheTtlOption:
+				if(atoi(optarg) <= 0)
+				{
+					cerr << "Decision cache ttl is invalid (must be > 0): " << atoi(optarg);
+					exit(1);
+				}
+				netherConfig.decisionCacheTtl		= atoi(optarg);
+				break;
+
+			case decisionSnapshotOption:
+				netherConfig.decisionSnapshotPath	= optarg;
+				break;
+
+			case decisionSnapshotIntervalOption:
+				if(atoi(optarg) < 0)
+				{
+					cerr << "Decision snapshot interval is invalid (must be >= 0): " << atoi(optarg);
+					exit(1);
+				}
+				netherConfig.decisionSnapshotInterval	= atoi(optarg);
+				break;
+
+			case hedgeDelayOption:
+				if(atoi(optarg) < 0)
+				{
+					cerr << "Hedge delay is invalid (must be >= 0): " << atoi(optarg);
+					exit(1);
+				}
+				netherConfig.hedgeDelay				= atoi(optarg);
+				break;
+
+			case breakerThresholdOption:
+				if(atoi(optarg) < 0)
+				{
+					cerr << "Circuit breaker threshold is invalid (must be >= 0): " << atoi(optarg);
+					exit(1);
+				}
+				netherConfig.breakerThreshold		= atoi(optarg);
+				break;
+
+			case breakerOpenTimeOption:
+				if(atoi(optarg) <= 0)
+				{
+					cerr << "Circuit breaker open time is invalid (must be > 0): " << atoi(optarg);
+					exit(1);
+				}
+				netherConfig.breakerOpenTime		= atoi(optarg);
+				break;
+
+			case logQueueOption:
+				if(atoi(optarg) < 0)
+				{
+					cerr << "Log queue size is invalid (must be >= 0): " << atoi(optarg);
+					exit(1);
+				}
+				netherConfig.logQueueSize			= atoi(optarg);
+				break;
+
+			case logQueueOverflowOption:
+				if(strcasecmp(optarg, "block") == 0)
+					netherConfig.logQueueBlock		= 1;
+				else if(strcasecmp(optarg, "drop") == 0)
+					netherConfig.logQueueBlock		= 0;
+				else
+				{
+					cerr << "Log queue overflow policy is invalid (must be DROP or BLOCK): " << optarg;
+					exit(1);
+				}
+				break;
+
+			case logRotateSizeOption:
+				if(atoi(optarg) < 0)
+				{
+					cerr << "Log rotate size is invalid (must be >= 0): " << atoi(optarg);
+					exit(1);
+				}
+				netherConfig.logRotateSize			= atoi(optarg);
+				break;
+
+			case logRotateCountOption:
+				if(atoi(optarg) <= 0)
+				{
+					cerr << "Log rotate count is invalid (must be > 0): " << atoi(optarg);
+					exit(1);
+				}
+				netherConfig.logRotateCount			= atoi(optarg);
+				break;
+
+			case metricsSocketOption:
+				netherConfig.metricsSocket			= optarg;
+				break;
+
+			case kernelQueueIntervalOption:
+				if(atoi(optarg) < 0)
+				{
+					cerr << "Kernel queue statistics interval is invalid (must be >= 0): " << atoi(optarg);
+					exit(1);
+				}
+				netherConfig.kernelQueueInterval	= atoi(optarg);
+				break;
+
+			case queueDepthWarningOption:
+				if(atoi(optarg) < 0)
+				{
+					cerr << "Queue depth warning is invalid (must be >= 0): " << atoi(optarg);
+					exit(1);
+				}
+				netherConfig.queueDepthWarning		= atoi(optarg);
+				break;
+
+			case queueMaxLengthOption:
+				if(atoi(optarg) < 0)
+				{
+					cerr << "Queue max length is invalid (must be >= 0): " << atoi(optarg);
+					exit(1);
+				}
+				netherConfig.queueMaxLength			= atoi(optarg);
+				break;
+
+			case netlinkBufferOption:
+				if(atoi(optarg) < 0 || atoi(optarg) > NETHER_NETLINK_BUFFER_MAX / 1024)
+				{
+					cerr << "Netlink buffer size is invalid (must be >= 0 and <= " << NETHER_NETLINK_BUFFER_MAX / 1024 << "): " << atoi(optarg);
+					exit(1);
+				}
+				netherConfig.netlinkBufferSize		= atoi(optarg);
+				break;
+
 			case 'h':
 				showHelp(argv[0]);
 				exit(1);
 		}
 	}
-	switch(netherConfig.logBackend)
-	{
-		case NetherLogBackendType::stderrBackend:
-			logger::Logger::setLogBackend(new logger::StderrBackend(false));
-			break;
-		case NetherLogBackendType::syslogBackend:
-			logger::Logger::setLogBackend(new logger::SyslogBackend());
-			break;
-		case NetherLogBackendType::logfileBackend:
-			logger::Logger::setLogBackend(new logger::FileBackend(netherConfig.logBackendArgs));
-			break;
-#if defined(HAVE_SYSTEMD_JOURNAL)
-		case NetherLogBackendType::journalBackend:
-			logger::Logger::setLogBackend(new logger::SystemdJournalBackend());
-			break;
-#endif
-		default:
-			logger::Logger::setLogBackend(new logger::StderrBackend(false));
-			break;
-	}
+	logger::Logger::setLogBackend(createLogBackend(netherConfig));
 
 	LOGD("NETHER OPTIONS:"
 #if defined(_DEBUG)
 		 << " debug"
 #endif
 		 << " daemon="					<< netherConfig.daemonMode
-		 << " queue="					<< netherConfig.queueNumber);
+		 << " queue="					<< netherConfig.queueNumber
+		 << " queues="					<< netherConfig.queueNumbers.size()
+		 << " pin-queues="				<< (netherConfig.pinQueues ? "yes" : "no"));
 	LOGD("primary-backend="				<< backendTypeToString(netherConfig.primaryBackendType)
 		 << " primary-backend-args="	<< netherConfig.primaryBackendArgs);
 	LOGD("backup-backend="				<< backendTypeToString(netherConfig.backupBackendType)
 		 << " backup-backend-args="		<< netherConfig.backupBackendArgs);
 	LOGD("default-verdict="				<< verdictToString(netherConfig.defaultVerdict)
 		 << " mark-deny="				<< (int)netherConfig.markDeny
-		 << " mark-allow-log="			<< (int)netherConfig.markAllowAndLog);
+		 << " mark-allow-log="			<< (int)netherConfig.markAllowAndLog
+		 << " mark-allow="				<< (int)netherConfig.markAllow
+		 << " connmark="				<< (netherConfig.connmarkVerdicts ? "yes" : "no"));
 	LOGD("log-backend="					<< logBackendTypeToString(netherConfig.logBackend)
-		 << " log-backend-args="		<< netherConfig.logBackendArgs);
+		 << " log-backend-args="		<< netherConfig.logBackendArgs
+		 << " log-queue="				<< netherConfig.logQueueSize
+		 << " log-queue-overflow="		<< (netherConfig.logQueueBlock ? "block" : "drop")
+		 << " log-rotate-size="			<< netherConfig.logRotateSize
+		 << " log-rotate-count="		<< netherConfig.logRotateCount);
 	LOGD("enable-audit="				<< (netherConfig.enableAudit ? "yes" : "no")
 		 << " rules-path="				<< netherConfig.rulesPath);
 	LOGD("no-rules="					<< (netherConfig.noRules ? "yes" : "no")
 		 << " iptables-restore-path="	<< netherConfig.iptablesRestorePath);
 	LOGD("interface-info="				<< (netherConfig.interfaceInfo ? "yes" : "no")
 		<< " copy-packets="				<< (netherConfig.copyPackets ? "yes" : "no"));
-	LOGD("relaxed="						<< (netherConfig.relaxed ? "yes" : "no"));
+	LOGD("relaxed="						<< (netherConfig.relaxed ? "yes" : "no")
+		<< " batch-verdicts="			<< (netherConfig.batchVerdicts ? "yes" : "no"));
+	LOGD("receive-batch="				<< netherConfig.receiveBatchSize
+		<< " netlink-budget="			<< netherConfig.netlinkBudget
+		<< " backend-budget="			<< netherConfig.backendBudget
+		<< " statistics-interval="		<< netherConfig.statisticsInterval
+		<< " metrics-socket="			<< netherConfig.metricsSocket);
+	LOGD("kernel-queue-interval="		<< netherConfig.kernelQueueInterval
+		<< " queue-depth-warning="		<< netherConfig.queueDepthWarning);
+	LOGD("queue-maxlen="				<< netherConfig.queueMaxLength
+		<< " netlink-buffer="			<< netherConfig.netlinkBufferSize
+		<< " fail-open="				<< (netherConfig.failOpen ? "yes" : "no")
+		<< " no-enobufs="				<< (netherConfig.noEnobufs ? "yes" : "no"));
+	LOGD("decision-cache-size="			<< netherConfig.decisionCacheSize
+		<< " decision-cache-ttl="		<< netherConfig.decisionCacheTtl);
+	LOGD("decision-snapshot="			<< netherConfig.decisionSnapshotPath
+		<< " decision-snapshot-interval="	<< netherConfig.decisionSnapshotInterval);
+	LOGD("hedge-delay="					<< netherConfig.hedgeDelay
+		<< " breaker-threshold="		<< netherConfig.breakerThreshold
+		<< " breaker-open-time="		<< netherConfig.breakerOpenTime);
 
 	NetherManager manager(netherConfig);
 
@@ -230,12 +489,14 @@ int main(int argc, char *argv[])
 		}
 		else
 		{
+			startAsyncLogging(netherConfig);
 			manager.process();
 		}
 	}
 	else
 	{
 		LOGD("Running in foreground");
+		startAsyncLogging(netherConfig);
 		manager.process();
 	}
 
@@ -250,12 +511,17 @@ void showHelp(char *arg)
 	cout<< "  -c,--copy-packets\t\t\tCopy entire packets, needed to read TCP/IP information (default:no)\n";
 	cout<< "  -I,--interface-info\t\t\tGet interface info for every packet (default:no)\n";
 	cout<< "  -R,--relaxed\t\t\t\tRun in relaxed mode, instrad of deny do ACCEPT_LOG(default:no)\n";
+	cout<< "     --batch-verdicts\t\t\tSend verdicts in batches, once per event loop iteration (default:no)\n";
 	cout<< "  -l,--log=<backend>\t\t\tSet logging backend STDERR,SYSLOG";
 #if defined(HAVE_SYSTEMD_JOURNAL)
 	cout << ",JOURNAL\n";
 #endif
 	cout<< "(default:"<< logBackendTypeToString(NETHER_LOG_BACKEND) << ")\n";
 	cout<< "  -L,--log-args=<arguments>\t\tSet logging backend arguments\n";
+	cout<< "     --log-queue=<messages>\t\tWrite log messages from a separate thread through a queue of this size, 0 writes them directly (default:" << NETHER_LOG_QUEUE_SIZE << ")\n";
+	cout<< "     --log-queue-overflow=<policy>\tWhat to do with log messages when the queue is full DROP,BLOCK (default:drop)\n";
+	cout<< "     --log-rotate-size=<kilobytes>\tRotate the log file when it gets bigger, 0 never rotates it (default:" << NETHER_LOG_ROTATE_SIZE << ")\n";
+	cout<< "     --log-rotate-count=<files>\tHow many rotated log files to keep (default:" << NETHER_LOG_ROTATE_COUNT << ")\n";
 	cout<< "  -V,--verdict=<verdict>\t\tWhat verdict to cast when policy backend is not available\n\t\t\t\t\tACCEPT,ALLOW_LOG,DENY (default:"<<verdictToString(NETHER_DEFAULT_VERDICT)<<")\n";
 	cout<< "  -p,--primary-backend=<module>\t\tPrimary policy backend\n\t\t\t\t\t";
 #if defined(HAVE_CYNARA)
@@ -270,13 +536,35 @@ void showHelp(char *arg)
 	cout<< ",FILE,NONE (defualt:"<< backendTypeToString(NETHER_BACKUP_BACKEND)<< ")\n";
 	cout<< "  -B,--backup-backend-args=<arguments>\tBackup policy backend arguments (default:" << NETHER_POLICY_FILE << ")\n";
 	cout<< "  -q,--queue-num=<queue number>\t\tNFQUEUE queue number to use for receiving packets (default:" << NETLINK_QUEUE_NUM << ")\n";
+	cout<< "     --queues=<queue numbers>\t\tNFQUEUE queues to use, each one in it's own thread, like 0-7 or 0,2,4\n";
+	cout<< "     --pin-queues\t\t\tPin the thread of the n-th queue to the n-th cpu (default:no)\n";
 	cout<< "  -m,--mark-deny=<mark>\t\t\tPacket mark to use for DENY verdicts (default:"<< NETLINK_DROP_MARK << ")\n";
 	cout<< "  -M,--mark-allow-log=<mark>\t\tPacket mark to use for ALLOW_LOG verdicts (default:" << NETLINK_ALLOWLOG_MARK << ")\n";
+	cout<< "     --connmark\t\t\t\tWrite verdicts to the connection mark, so only the first packet is queued (default:no)\n";
+	cout<< "     --mark-allow=<mark>\t\tConnection mark to use for ALLOW verdicts with --connmark (default:" << NETLINK_ALLOW_MARK << ")\n";
 #if defined(HAVE_AUDIT)
 	cout<< "  -a,--enable-audit\t\t\tEnable the auditing subsystem (default: no)\n";
 #endif
 	cout<< "  -r,--rules-path=<path>\t\tPath to iptables rules file (default:" << NETHER_RULES_PATH << ")\n";
 	cout<< "  -i,--iptables-restore-path=<path>\tPath to iptables-restore command (default:" << NETHER_IPTABLES_RESTORE_PATH << ")\n";
+	cout<< "     --receive-batch=<messages>\tRead up to this many netlink messages with one recvmmsg(), 0 reads one at a time (default:0)\n";
+	cout<< "     --netlink-budget=<messages>\tMax netlink messages to handle in one event loop iteration (default:" << NETHER_NETLINK_BUDGET << ")\n";
+	cout<< "     --backend-budget=<events>\tMax policy backend events to handle in one event loop iteration (default:" << NETHER_BACKEND_BUDGET << ")\n";
+	cout<< "     --statistics-interval=<seconds>\tLog statistics periodically, 0 logs them only on SIGUSR1 (default:" << NETHER_STATISTICS_INTERVAL << ")\n";
+	cout<< "     --metrics-socket=<path>\tServe the metrics in the Prometheus text format on this unix socket (default:none)\n";
+	cout<< "     --kernel-queue-interval=<ms>\tRead the kernel statistics of the queues this often, 0 never reads them (default:" << NETHER_KERNEL_QUEUE_INTERVAL << ")\n";
+	cout<< "     --queue-depth-warning=<packets>\tWarn when this many packets wait in the kernel queue, 0 never warns (default:" << NETHER_QUEUE_DEPTH_WARNING << ")\n";
+	cout<< "     --queue-maxlen=<packets>\tHow many packets the kernel queue holds, 0 keeps the kernel default (default:" << NETHER_QUEUE_MAXLEN << ")\n";
+	cout<< "     --netlink-buffer=<kilobytes>\tSize of the netlink socket receive buffer, 0 keeps the system default (default:" << NETHER_NETLINK_BUFFER_SIZE << ")\n";
+	cout<< "     --fail-open\t\t\t\tAccept packets the kernel can't queue instead of dropping them (default:no)\n";
+	cout<< "     --no-enobufs\t\t\tDon't report a full netlink socket buffer with ENOBUFS (default:no)\n";
+	cout<< "     --decision-cache-size=<entries>\tCache this many policy decisions, 0 disables the cache (default:" << NETHER_DECISION_CACHE_SIZE << ")\n";
+	cout<< "     --decision-cache-ttl=<seconds>\tHow long a cached decision is used (default:" << NETHER_DECISION_CACHE_TTL << ")\n";
+	cout<< "     --decision-snapshot=<path>\tSave cached decisions to <path>.<queue> and use them after a restart (default: none)\n";
+	cout<< "     --decision-snapshot-interval=<seconds>\tSave the decision snapshot periodically, 0 saves it only when stopping (default:" << NETHER_DECISION_SNAPSHOT_INTERVAL << ")\n";
+	cout<< "     --hedge-delay=<ms>\t\tAsk the backup backend too if the primary has not answered in this time, 0 disables it (default:" << NETHER_HEDGE_DELAY << ")\n";
+	cout<< "     --breaker-threshold=<failures>\tStop using a backend after this many failures in a row, 0 never stops (default:" << NETHER_BREAKER_THRESHOLD << ")\n";
+	cout<< "     --breaker-open-time=<ms>\tHow long to wait before trying a stopped backend again (default:" << NETHER_BREAKER_OPEN_TIME << ")\n";
 	cout<< "  -h,--help\t\t\t\tshow help information\n";
 }
 
@@ -284,3 +572,35 @@ void cleanupAndExit()
 {
 	exit (1);
 }
+
+logger::LogBackend *createLogBackend(const NetherConfig &netherConfig)
+{
+	switch(netherConfig.logBackend)
+	{
+		case NetherLogBackendType::stderrBackend:
+			return (new logger::StderrBackend(false));
+		case NetherLogBackendType::syslogBackend:
+			return (new logger::SyslogBackend());
+		case NetherLogBackendType::logfileBackend:
+			return (new logger::FileBackend(netherConfig.logBackendArgs, (size_t)netherConfig.logRotateSize * 1024, netherConfig.logRotateCount));
+#if defined(HAVE_SYSTEMD_JOURNAL)
+		case NetherLogBackendType::journalBackend:
+			return (new logger::SystemdJournalBackend());
+#endif
+		default:
+			return (new logger::StderrBackend(false));
+	}
+}
+
+/* The writer thread would not survive the fork() of runAsDaemon(),
+	so the queue is set up right before packets are processed, no other
+	thread is logging yet at that point */
+void startAsyncLogging(const NetherConfig &netherConfig)
+{
+	if(netherConfig.logQueueSize == 0)
+		return;
+
+	logger::Logger::setLogBackend(new logger::AsyncBackend(createLogBackend(netherConfig), netherConfig.logQueueSize,
+								  netherConfig.logQueueBlock ? logger::OverflowPolicy::BLOCK : logger::OverflowPolicy::DROP));
+	LOGD("Logging through a queue of " << netherConfig.logQueueSize << " messages");
+}
@@ -26,35 +26,118 @@
 #include "nether_CynaraBackend.h"
 #include "nether_FileBackend.h"
 #include "nether_DummyBackend.h"
+#include "nether_DecisionSnapshot.h"
 
-NetherManager::NetherManager(const NetherConfig &_netherConfig)
+#include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+NetherManager::NetherManager(const NetherConfig &_netherConfig, const bool _queueWorker)
 	:	netherPrimaryPolicyBackend(nullptr),
 		netherBackupPolicyBackend(nullptr),
 		netherFallbackPolicyBackend(nullptr),
-		netherConfig(_netherConfig)
+		inFlightCount(0),
+		primaryBreaker(backendTypeToString(_netherConfig.primaryBackendType) + " primary",
+					   _netherConfig.breakerThreshold, _netherConfig.breakerOpenTime),
+		backupBreaker(backendTypeToString(_netherConfig.backupBackendType) + " backup",
+					  _netherConfig.breakerThreshold, _netherConfig.breakerOpenTime),
+		netherConfig(_netherConfig),
+		netlinkDescriptor(-1),
+		backendDescriptor(-1),
+		signalDescriptor(-1),
+		controlDescriptor(-1),
+		workerExitDescriptor(-1),
+		queueWorker(_queueWorker),
+		stopRequested(false),
+		controlRequests(0)
 {
+	netherEventLoop             = std::unique_ptr<NetherEventLoop> (new NetherEventLoop());
+
+	/* With more then one queue, each one gets it's own manager
+		(netlink, policy backends and event loop) running in it's own thread,
+		this one only takes care of signals and the iptables rules */
+	if(netherConfig.queueNumbers.size() > 1)
+	{
+		for(auto &queueNumber : netherConfig.queueNumbers)
+		{
+			NetherConfig queueConfig	= netherConfig;
+			queueConfig.queueNumber		= queueNumber;
+			queueConfig.queueNumbers.clear();
+			queueWorkers.push_back(std::unique_ptr<NetherManager> (new NetherManager(queueConfig, true)));
+		}
+
+		return;
+	}
+
 	netherNetlink               = std::unique_ptr<NetherNetlink> (new NetherNetlink(netherConfig));
 	netherNetlink->setListener(this);
+	netherNetlink->setMetrics(&metrics);
+
+	primaryBreaker.setMetrics(&metrics.primaryCircuit);
+	backupBreaker.setMetrics(&metrics.backupCircuit);
 
 	netherPrimaryPolicyBackend	= std::unique_ptr<NetherPolicyBackend> (getPolicyBackend(netherConfig));
 	netherPrimaryPolicyBackend->setListener(this);
+	netherPrimaryPolicyBackend->setDescriptorListener(this);
+	netherPrimaryPolicyBackend->setMetrics(&metrics);
 
 	netherBackupPolicyBackend   = std::unique_ptr<NetherPolicyBackend> (getPolicyBackend(netherConfig, false));
 	netherBackupPolicyBackend->setListener(this);
+	netherBackupPolicyBackend->setMetrics(&metrics);
 
 	netherFallbackPolicyBackend = std::unique_ptr<NetherPolicyBackend> (new NetherDummyBackend(netherConfig));
+
+	packetLatency				= std::unique_ptr<NetherPacketLatency> (new NetherPacketLatency());
+
+	if(netherConfig.decisionCacheSize > 0)
+	{
+		decisionCache			= std::unique_ptr<NetherDecisionCache> (new NetherDecisionCache(netherConfig.decisionCacheSize, netherConfig.decisionCacheTtl));
+		pendingDecisions.resize(NETHER_PENDING_RING_SIZE, NetherPendingDecision{0, false, NetherDecisionKey{NETHER_NO_LABEL, 0, 0}});
+	}
+
+	if(netherConfig.hedgeDelay > 0)
+		inFlightPackets.resize(NETHER_PENDING_RING_SIZE, NetherInFlightPacket{NetherPacket(), false, false, false});
 }
 
 NetherManager::~NetherManager()
 {
-	close(signalDescriptor);
+	for(auto &worker : queueWorkers)
+		worker->requestControl(NETHER_CONTROL_STOP);
+
+	for(auto &workerThread : workerThreads)
+		workerThread.join();
+
+	if(signalDescriptor != -1)
+		close(signalDescriptor);
+
+	if(controlDescriptor != -1)
+		close(controlDescriptor);
+
+	if(workerExitDescriptor != -1)
+		close(workerExitDescriptor);
 }
 
 bool NetherManager::initialize()
 {
+	if(!netherEventLoop->initialize())
+	{
+		LOGE("Failed to initialize the event loop, exiting");
+		return (false);
+	}
+
+	/* queue workers don't deal with signals, audit and rules,
+		the main manager does that for them */
+	if(queueWorker)
+		return (initializeQueue());
+
 	sigemptyset(&signalMask);
 	sigaddset(&signalMask, SIGHUP);
+	sigaddset(&signalMask, SIGUSR1);
+	sigaddset(&signalMask, SIGTERM);
+	sigaddset(&signalMask, SIGINT);
 
+	/* this needs to happen before any worker thread starts
+		so that all of them inherit the signal mask */
 	if(sigprocmask(SIG_BLOCK, &signalMask, NULL) == -1)
 	{
 		LOGE("Failed to block signals sigprocmask()");
@@ -89,12 +172,149 @@ bool NetherManager::initialize()
 	}
 #endif // HAVE_AUDIT
 
-	if(!netherNetlink->initialize())
+	if(queueWorkers.empty())
+	{
+		if(!initializeQueue())
+			return (false);
+	}
+	else
+	{
+		for(auto &worker : queueWorkers)
+		{
+			if(!worker->initialize())
+			{
+				LOGE("Failed to initialize queue " << worker->getConfig().queueNumber << ", exiting");
+				return (false);
+			}
+		}
+
+		if((workerExitDescriptor = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1)
+		{
+			LOGE("Failed to create worker exit descriptor: " << strerror(errno));
+			return (false);
+		}
+
+		if(!netherEventLoop->addDescriptor(workerExitDescriptor, EPOLLIN, "worker", 1,
+										   [](const uint32_t, const int) { LOGE("Queue worker failed"); return (-1); }))
+		{
+			return (false);
+		}
+	}
+
+	if(netherConfig.kernelQueueInterval > 0 && !initializeKernelQueue())
+		return (false);
+
+	if(!netherConfig.metricsSocket.empty() && !initializeMetrics())
+		return (false);
+
+	/* Load the rules as last, in case we have a problem with any
+		above subsystems, we won't leave hanging useless rules */
+	if(netherConfig.noRules == 0 && restoreRules() == false)
+	{
+		LOGE("Failed to setup iptables rules");
+		return (false);
+	}
+
+	if(!netherEventLoop->addDescriptor(signalDescriptor, EPOLLIN, "signal", 1,
+									   [this](const uint32_t, const int) { return (handleSignal()); }))
+	{
+		return (false);
+	}
+
+	/* buffered log lines are written at least once a second, even when nothing else is logged */
+	if(netherConfig.logBackend == NetherLogBackendType::logfileBackend &&
+			netherEventLoop->addTimer("log flush", 1000, []() { logger::Logger::flush(); }) == -1)
+	{
+		return (false);
+	}
+
+	/* a rate limited message that stopped repeating still reports how many were suppressed */
+	if(netherEventLoop->addTimer("log summary", LOG_RATELIMIT_INTERVAL_MS, []() { logger::RateLimit::flushSuppressed(); }) == -1)
+		return (false);
+
+	if(netherConfig.statisticsInterval > 0 &&
+			netherEventLoop->addTimer("statistics", netherConfig.statisticsInterval * 1000, [this]() { logStatistics(); }) == -1)
 	{
-		LOGE("Failed to initialize netlink subsystem, exiting");
 		return (false);
 	}
 
+	return (true);
+}
+
+/* The metrics are read in this thread, without stopping the queue threads */
+bool NetherManager::initializeMetrics()
+{
+	metricsServer = std::unique_ptr<NetherMetricsServer> (new NetherMetricsServer(netherConfig.metricsSocket));
+
+	if(!metricsServer->initialize())
+		return (false);
+
+	if(queueWorkers.empty())
+	{
+		metricsServer->addShard(netherConfig.queueNumber, &metrics, packetLatency.get());
+	}
+	else
+	{
+		metricsServer->addShard(-1, &metrics);
+
+		for(auto &worker : queueWorkers)
+			metricsServer->addShard(worker->getConfig().queueNumber, &worker->getMetrics(), worker->getPacketLatency());
+	}
+
+	if(kernelQueue)
+		metricsServer->setKernelQueue(kernelQueue.get());
+
+	return (netherEventLoop->addDescriptor(metricsServer->getDescriptor(), EPOLLIN, "metrics", NETHER_METRICS_CLIENTS,
+										   [this](const uint32_t, const int budget) { return (metricsServer->handleClients(budget)); }));
+}
+
+/* The kernel statistics of all queues are in one file, so the main
+	thread reads them for all queue threads */
+bool NetherManager::initializeKernelQueue()
+{
+	std::vector<int> queueNumbers = netherConfig.queueNumbers;
+
+	if(queueNumbers.empty())
+		queueNumbers.push_back(netherConfig.queueNumber);
+
+	kernelQueue = std::unique_ptr<NetherKernelQueue> (new NetherKernelQueue(queueNumbers, netherConfig.queueDepthWarning));
+	kernelQueue->setDepthHandler([this](const NetherKernelQueueStatus &status) { queueDepthChanged(status); });
+
+	return (netherEventLoop->addTimer("kernel queue", netherConfig.kernelQueueInterval, [this]() { kernelQueue->collect(); }) != -1);
+}
+
+void NetherManager::queueDepthChanged(const NetherKernelQueueStatus &status)
+{
+	const NetherPacketLatency *queueLatency = packetLatency.get();
+	NetherLatencyHistogram latency;
+
+	for(auto &worker : queueWorkers)
+	{
+		if(worker->getConfig().queueNumber == (int)status.queueNumber)
+			queueLatency = worker->getPacketLatency();
+	}
+
+	if(queueLatency)
+		queueLatency->getTotal(latency);
+
+	if(status.overThreshold)
+	{
+		metrics.queueDepthWarnings.add();
+		LOGW("queue=" << status.queueNumber << " has " << status.pending << " packet(s) waiting in the kernel"
+			 << " (warning at " << netherConfig.queueDepthWarning << ")"
+			 << " latency p99=" << latency.getPercentile(99) / 1000 << "us");
+	}
+	else
+	{
+		LOGI("queue=" << status.queueNumber << " has " << status.pending << " packet(s) waiting in the kernel, back under "
+			 << netherConfig.queueDepthWarning);
+	}
+}
+
+bool NetherManager::initializeQueue()
+{
+	/* The policy backends start before the queue is bound,
+		so they can get ready (warm up their caches) first */
 	if(!netherPrimaryPolicyBackend->initialize())
 	{
 		LOGE("Failed to initialize primary policy backend, exiting");
@@ -107,23 +327,76 @@ bool NetherManager::initialize()
 		return (false);
 	}
 
+	/* the policy is loaded now, decisions made with the same
+		policy before a restart can be used for the first packets */
+	loadDecisionSnapshot();
+
+	if(!netherNetlink->initialize())
+	{
+		LOGE("Failed to initialize netlink subsystem, exiting");
+		return (false);
+	}
+
+	if(netherPrimaryPolicyBackend->getTimeoutInterval() > 0 &&
+			netherEventLoop->addTimer("backend timeouts", netherPrimaryPolicyBackend->getTimeoutInterval(),
+									  [this]() { netherPrimaryPolicyBackend->processTimeouts(); }) == -1)
+	{
+		return (false);
+	}
+
+	/* the timer resolution is a quarter of the delay */
+	if(netherConfig.hedgeDelay > 0 &&
+			netherEventLoop->addTimer("hedge", std::max(1, netherConfig.hedgeDelay / 4), [this]() { hedgeSlowPackets(); }) == -1)
+	{
+		return (false);
+	}
+
+	if(decisionCache && !netherConfig.decisionSnapshotPath.empty() && netherConfig.decisionSnapshotInterval > 0 &&
+			netherEventLoop->addTimer("decision snapshot", netherConfig.decisionSnapshotInterval * 1000,
+									  [this]() { saveDecisionSnapshot(false); }) == -1)
+	{
+		return (false);
+	}
+
 	if((netlinkDescriptor = netherNetlink->getDescriptor()) == -1)
 	{
 		LOGE("Netlink subsystem did not return a valid descriptor, exiting");
 		return (false);
 	}
 
-	/* Load the rules as last, in case we have a problem with any
-		above subsystems, we won't leave hanging useless rules */
-	if(netherConfig.noRules == 0 && restoreRules() == false)
+	/* without a receive batch, one message is read per wakeup */
+	if(!netherEventLoop->addDescriptor(netlinkDescriptor, EPOLLIN, "netlink",
+									   netherConfig.receiveBatchSize > 0 ? netherConfig.netlinkBudget : 1,
+									   [this](const uint32_t, const int budget) { return (handleNetlinkpacket(budget)); }))
 	{
-		LOGE("Failed to setup iptables rules");
 		return (false);
 	}
 
-	if((backendDescriptor = netherPrimaryPolicyBackend->getDescriptor()) == -1)
+	/* All descriptor changes are reported through descriptorChanged(),
+		pick up whatever the backend set up before we started listening */
+	if(backendDescriptor == -1)
+	{
+		descriptorChanged(-1, netherPrimaryPolicyBackend->getDescriptor(), netherPrimaryPolicyBackend->getDescriptorStatus());
+	}
+
+	if(backendDescriptor == -1)
 	{
-		LOGI("Policy backend does not provide descriptor for select()");
+		LOGI("Policy backend does not provide descriptor for the event loop yet");
+	}
+
+	if(queueWorker)
+	{
+		if((controlDescriptor = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1)
+		{
+			LOGE("Failed to create control descriptor: " << strerror(errno));
+			return (false);
+		}
+
+		if(!netherEventLoop->addDescriptor(controlDescriptor, EPOLLIN, "control", 1,
+										   [this](const uint32_t, const int) { return (handleControl()); }))
+		{
+			return (false);
+		}
 	}
 
 	return (true);
@@ -131,43 +404,171 @@ bool NetherManager::initialize()
 
 bool NetherManager::process()
 {
-	fd_set watchedReadDescriptorsSet, watchedWriteDescriptorsSet;
-	struct timeval timeoutSpecification;
+	startQueueWorkers();
 
 	for(;;)
 	{
-		setupSelectSockets(watchedReadDescriptorsSet, watchedWriteDescriptorsSet, timeoutSpecification);
-
-		if(select(FD_SETSIZE, &watchedReadDescriptorsSet, &watchedWriteDescriptorsSet, NULL, &timeoutSpecification) < 0)
+		if(!netherEventLoop->dispatch())
 		{
-			LOGE("select error " << strerror(errno));
+			if(stopRequested)
+			{
+				if(netherNetlink)
+					netherNetlink->flushVerdicts();
+				saveDecisionSnapshot(true);
+				return (true);
+			}
+
+			LOGE("Event loop failed, refusing to continue");
 			return (false);
 		}
 
-		if(FD_ISSET(signalDescriptor, &watchedReadDescriptorsSet))
-		{
-			handleSignal();
-		}
-		if(FD_ISSET(netlinkDescriptor, &watchedReadDescriptorsSet))
+		/* verdicts cast during this iteration are sent now */
+		if(netherNetlink)
+			netherNetlink->flushVerdicts();
+	}
+
+	return (true);
+}
+
+void NetherManager::startQueueWorkers()
+{
+	const long cpuCount = sysconf(_SC_NPROCESSORS_ONLN);
+
+	for(size_t index = 0; index < queueWorkers.size(); index++)
+	{
+		NetherManager *worker = queueWorkers[index].get();
+		const int cpu = cpuCount > 0 ? index % cpuCount : 0;
+
+		workerThreads.push_back(std::thread([this, worker, cpu]()
 		{
-			if(!handleNetlinkpacket())
-				break;
-		}
-		else
-			if(FD_ISSET(backendDescriptor, &watchedReadDescriptorsSet) || FD_ISSET(backendDescriptor, &watchedWriteDescriptorsSet))
+			if(netherConfig.pinQueues)
 			{
-				netherPrimaryPolicyBackend->processEvents();
+				cpu_set_t cpuSet;
+				CPU_ZERO(&cpuSet);
+				CPU_SET(cpu, &cpuSet);
+
+				if(pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) != 0)
+					LOGW("Failed to pin queue " << worker->getConfig().queueNumber << " to cpu " << cpu);
 			}
-			else
+
+			LOGD("queue " << worker->getConfig().queueNumber << " worker started");
+
+			/* let the main thread know, it will exit too */
+			if(!worker->process())
 			{
-				LOGD("select() timeout");
+				uint64_t exitEvent = 1;
+
+				if(write(workerExitDescriptor, &exitEvent, sizeof(exitEvent)) != sizeof(exitEvent))
+					LOGE("Failed to notify about queue worker exit");
 			}
+		}));
 	}
+}
 
-	return (true);
+void NetherManager::requestControl(const uint32_t request)
+{
+	uint64_t controlEvent = 1;
+
+	controlRequests.fetch_or(request);
+
+	if(write(controlDescriptor, &controlEvent, sizeof(controlEvent)) != sizeof(controlEvent))
+		LOGW("Failed to send control request to queue " << netherConfig.queueNumber);
+}
+
+int NetherManager::handleControl()
+{
+	uint64_t controlEvents;
+	uint32_t requests;
+
+	if(read(controlDescriptor, &controlEvents, sizeof(controlEvents)) != sizeof(controlEvents))
+		return (0);
+
+	requests = controlRequests.exchange(0);
+
+	if(requests & NETHER_CONTROL_RELOAD)
+		reload();
+
+	if(requests & NETHER_CONTROL_STATISTICS)
+		logStatistics();
+
+	if(requests & NETHER_CONTROL_STOP)
+	{
+		stopRequested = true;
+		return (-1);
+	}
+
+	return (1);
+}
+
+int NetherManager::handleBackendEvents(const int budget)
+{
+	struct pollfd backendPoll;
+	int unitsHandled = 0;
+
+	backendPoll.fd		= backendDescriptor;
+	backendPoll.events	= POLLIN;
+
+	/* Keep processing backend responses while there are any, up to our
+		budget. A failure here is not fatal, the backend will recover
+		or the packets will go to the backup backend */
+	do
+	{
+		netherPrimaryPolicyBackend->processEvents();
+		unitsHandled++;
+	}
+	while(unitsHandled < budget &&
+			backendDescriptor != -1 &&
+			backendPoll.fd == backendDescriptor &&
+			poll(&backendPoll, 1, 0) == 1 &&
+			(backendPoll.revents & POLLIN));
+
+	return (unitsHandled);
+}
+
+void NetherManager::descriptorChanged(const int oldDescriptor, const int newDescriptor, const NetherDescriptorStatus status)
+{
+	LOGD("Policy backend descriptor changed old=" << oldDescriptor << " new=" << newDescriptor);
+
+	if(backendDescriptor != -1 && backendDescriptor != newDescriptor)
+	{
+		netherEventLoop->removeDescriptor(backendDescriptor);
+		backendDescriptor = -1;
+	}
+
+	if(newDescriptor == -1)
+		return;
+
+	/* A backend that reconnected can get the number of it's old descriptor
+		back, the old one was closed so epoll does not know it anymore and
+		it has to be added again */
+	if(backendDescriptor == newDescriptor && netherEventLoop->modifyDescriptor(newDescriptor, descriptorStatusToEvents(status)))
+		return;
+
+	if(backendDescriptor != -1)
+	{
+		netherEventLoop->removeDescriptor(backendDescriptor);
+		backendDescriptor = -1;
+	}
+
+	if(!netherEventLoop->addDescriptor(newDescriptor, descriptorStatusToEvents(status), "backend", netherConfig.backendBudget,
+									   [this](const uint32_t, const int budget) { return (handleBackendEvents(budget)); }))
+	{
+		LOGE("Can't watch the policy backend descriptor=" << newDescriptor << " (was " << oldDescriptor << "), it's checks will time out");
+		return;
+	}
+
+	backendDescriptor = newDescriptor;
+}
+
+uint32_t NetherManager::descriptorStatusToEvents(const NetherDescriptorStatus status)
+{
+	if(status == NetherDescriptorStatus::readWrite)
+		return (EPOLLIN | EPOLLOUT);
+
+	return (EPOLLIN);
 }
 
-void NetherManager::handleSignal()
+int NetherManager::handleSignal()
 {
 	LOGD("received signal");
 	ssize_t signalRead;
@@ -178,84 +579,263 @@ void NetherManager::handleSignal()
 	if(signalRead != sizeof(struct signalfd_siginfo))
 	{
 		LOGW("Received incomplete signal information, ignore");
-		return;
+		return (0);
 	}
 
 	if(signalfdSignalInfo.ssi_signo == SIGHUP)
 	{
 		LOGI("SIGHUP received, reloading");
-		if(!netherPrimaryPolicyBackend->reload())
-			LOGW("primary backend failed to reload");
-		if(!netherBackupPolicyBackend->reload())
-			LOGW("backup backend failed to reload");
-		if(!netherNetlink->reload())
-			LOGW("netlink failed to reload");
+
+		/* the log file might have been moved away by logrotate */
+		logger::Logger::reopen();
+		metrics.reloads.add();
+
+		if(queueWorkers.empty())
+			reload();
+
+		for(auto &worker : queueWorkers)
+			worker->requestControl(NETHER_CONTROL_RELOAD);
 	}
+
+	if(signalfdSignalInfo.ssi_signo == SIGUSR1)
+	{
+		logStatistics();
+	}
+
+	/* leave the event loop, so that everything is shut down properly */
+	if(signalfdSignalInfo.ssi_signo == SIGTERM || signalfdSignalInfo.ssi_signo == SIGINT)
+	{
+		LOGI("Signal " << signalfdSignalInfo.ssi_signo << " received, stopping");
+		stopRequested = true;
+		return (-1);
+	}
+
+	return (1);
 }
 
-bool NetherManager::handleNetlinkpacket()
+void NetherManager::reload()
 {
-	LOGD("netlink descriptor active");
-	int packetReadSize;
-	NetherPacket receivedPacket;
-	char packetBuffer[NETHER_PACKET_BUFFER_SIZE] __attribute__((aligned));
+	/* decisions made with the old policy, including those still
+		in flight, must not be used anymore */
+	if(decisionCache)
+	{
+		decisionCache->clear();
+
+		for(auto &pendingDecision : pendingDecisions)
+			pendingDecision.inUse = false;
+	}
 
-	/* some data arrives on netlink, read it */
-	if((packetReadSize = recv(netlinkDescriptor, packetBuffer, sizeof(packetBuffer), 0)) >= 0)
+	if(!netherPrimaryPolicyBackend->reload())
+		LOGW("primary backend failed to reload");
+	if(!netherBackupPolicyBackend->reload())
+		LOGW("backup backend failed to reload");
+	if(!netherNetlink->reload())
+		LOGW("netlink failed to reload");
+}
+
+void NetherManager::logStatistics()
+{
+	if(kernelQueue)
 	{
-		/* try to process the packet using netfilter_queue library, fetch packet info
-		    needed for making a decision about it */
-		if(netherNetlink->processPacket(packetBuffer, packetReadSize))
+		for(auto &status : kernelQueue->getStatus())
 		{
-			return (true);
+			if(status.seen)
+				LOGI("kernel queue=" << status.queueNumber
+					 << " pending=" << status.pending
+					 << " queue dropped=" << status.queueDropped
+					 << " user dropped=" << status.userDropped);
 		}
-		else
+	}
+
+	if(!queueWorkers.empty())
+	{
+		uint64_t allPackets = 0;
+
+		for(auto &worker : queueWorkers)
+			allPackets += worker->getPacketsReceived();
+
+		/* each worker logs the rest of it's statistics from it's own thread */
+		for(auto &worker : queueWorkers)
 		{
-			/* if we can't process the incoming packets, it's bad. Let's exit now */
-			LOGE("Failed to process netlink received packet, refusing to continue");
-			return (false);
+			LOGI("queue=" << worker->getConfig().queueNumber
+				 << " packets received=" << worker->getPacketsReceived()
+				 << " share=" << (allPackets ? (worker->getPacketsReceived() * 100) / allPackets : 0) << "%");
+
+			worker->requestControl(NETHER_CONTROL_STATISTICS);
 		}
+
+		return;
 	}
 
-	if(packetReadSize < 0 && errno == ENOBUFS)
+	LOGI("queue=" << netherConfig.queueNumber
+		 << " packets received=" << getPacketsReceived());
+
+	LOGI("verdicts issued=" << netherNetlink->getVerdictsIssued()
+		 << " verdict syscalls=" << netherNetlink->getVerdictSyscalls()
+		 << " verdict syscalls saved=" << netherNetlink->getVerdictSyscallsSaved());
+
+	if(decisionCache)
 	{
-		LOGI("NetherManager::process losing packets! [bad things might happen]");
-		return (true);
+		LOGI("decision cache size=" << decisionCache->getSize()
+			 << " hits=" << decisionCache->getHits()
+			 << " misses=" << decisionCache->getMisses()
+			 << " evictions=" << decisionCache->getEvictions());
 	}
 
-	LOGE("NetherManager::process recv failed " << strerror(errno));
-	return (false);
+	logLatency();
+
+	if(netherConfig.hedgeDelay > 0)
+	{
+		LOGI("hedge delay=" << netherConfig.hedgeDelay << "ms"
+			 << " verdicts in time=" << metrics.verdictsInTime.get()
+			 << " packets hedged=" << metrics.packetsHedged.get()
+			 << " late verdicts dropped=" << metrics.lateVerdictsDropped.get()
+			 << " in flight=" << inFlightCount);
+	}
+
+	for(auto breaker : {&primaryBreaker, &backupBreaker})
+	{
+		if(breaker->getTimesOpened() == 0 && breaker->getState() == NetherCircuitState::closed)
+			continue;
+
+		LOGI(breaker->getName() << " backend circuit=" << NetherCircuitBreaker::stateToString(breaker->getState())
+			 << " opened=" << breaker->getTimesOpened()
+			 << " probes=" << breaker->getProbes()
+			 << " closed=" << breaker->getTimesClosed()
+			 << " packets diverted=" << breaker->getRequestsRejected());
+	}
+
+	netherPrimaryPolicyBackend->logStatistics();
+
+	for(auto &source : netherEventLoop->getStatistics())
+	{
+		LOGI("event source=" << source.first
+			 << " wakeups=" << source.second.wakeups
+			 << " units handled=" << source.second.unitsHandled
+			 << " budget exhausted=" << source.second.budgetExhausted);
+	}
+}
+
+void NetherManager::logLatency()
+{
+	NetherLatencyHistogram totalLatency;
+
+	packetLatency->getTotal(totalLatency);
+
+	if(totalLatency.getCount() == 0)
+		return;
+
+	LOGI("packet latency " << totalLatency.toString() << " untracked=" << packetLatency->getUntracked());
+
+	for(auto source : {NetherLatencySource::decisionCache, NetherLatencySource::cynaraCache, NetherLatencySource::cynara,
+					   NetherLatencySource::file, NetherLatencySource::fallback})
+	{
+		for(auto verdict : {NetherVerdict::allow, NetherVerdict::allowAndLog, NetherVerdict::deny})
+		{
+			const NetherLatencyHistogram &latency = packetLatency->getHistogram(source, verdict);
+
+			if(latency.getCount() > 0)
+				LOGI("packet latency source=" << NetherPacketLatency::sourceToString(source)
+					 << " verdict=" << verdictToString(verdict)
+					 << " " << latency.toString());
+		}
+	}
+}
+
+/* Everything the cached decisions depend on, a snapshot
+	is only used with the same policy generation */
+uint64_t NetherManager::getPolicyGeneration()
+{
+	const uint64_t backendGeneration = netherPrimaryPolicyBackend->getPolicyGeneration();
+	uint64_t generation;
+
+	generation = fingerprint(&netherConfig.primaryBackendType, sizeof(netherConfig.primaryBackendType));
+	generation = fingerprint(netherConfig.primaryBackendArgs, generation);
+	generation = fingerprint(netherConfig.backupBackendArgs, generation);
+	generation = fingerprint(&netherConfig.defaultVerdict, sizeof(netherConfig.defaultVerdict), generation);
+	generation = fingerprint(&backendGeneration, sizeof(backendGeneration), generation);
+
+	return (generation);
+}
+
+void NetherManager::loadDecisionSnapshot()
+{
+	std::vector<NetherDecisionCacheEntry> entries;
+
+	if(!decisionCache || netherConfig.decisionSnapshotPath.empty())
+		return;
+
+	if(!NetherDecisionSnapshot::read(netherConfig.decisionSnapshotPath + "." + std::to_string(netherConfig.queueNumber),
+									 getPolicyGeneration(), entries))
+		return;
+
+	/* least recently used first, so the order in the cache is kept */
+	for(auto entry = entries.rbegin(); entry != entries.rend(); entry++)
+		decisionCache->insert(entry->key, entry->decision, entry->secondsLeft);
+
+	LOGI("decision cache seeded with " << decisionCache->getSize() << " decision(s) from the snapshot");
 }
 
-void NetherManager::setupSelectSockets(fd_set &watchedReadDescriptorsSet, fd_set &watchedWriteDescriptorsSet, struct timeval &timeoutSpecification)
+void NetherManager::saveDecisionSnapshot(const bool durable)
 {
-	FD_ZERO(&watchedReadDescriptorsSet);
-	FD_ZERO(&watchedWriteDescriptorsSet);
+	std::vector<NetherDecisionCacheEntry> entries;
 
-	/* Always listen for signals */
-	FD_SET(signalDescriptor, &watchedReadDescriptorsSet);
+	if(!decisionCache || netherConfig.decisionSnapshotPath.empty())
+		return;
+
+	decisionCache->getEntries(entries);
+	NetherDecisionSnapshot::write(netherConfig.decisionSnapshotPath + "." + std::to_string(netherConfig.queueNumber),
+								  getPolicyGeneration(), entries, durable);
+}
 
-	if((netlinkDescriptor = netherNetlink->getDescriptor()) >= 0)
+int NetherManager::handleNetlinkpacket(const int budget)
+{
+	LOGD("netlink descriptor active");
+	int packetReadSize;
+	char packetBuffer[NETHER_PACKET_BUFFER_SIZE] __attribute__((aligned));
+
+	if(netherConfig.receiveBatchSize > 0)
 	{
-		FD_SET(netlinkDescriptor, &watchedReadDescriptorsSet);
+		if((packetReadSize = netherNetlink->receivePackets(budget)) < 0)
+		{
+			LOGE("Failed to process netlink received packets, refusing to continue");
+			return (-1);
+		}
+
+		return (packetReadSize);
 	}
 
-	if((backendDescriptor = netherPrimaryPolicyBackend->getDescriptor()) >= 0)
+	/* some data arrives on netlink, read it, MSG_TRUNC gives the real size */
+	if((packetReadSize = recv(netlinkDescriptor, packetBuffer, sizeof(packetBuffer), MSG_TRUNC)) >= 0)
 	{
-		if(netherPrimaryPolicyBackend->getDescriptorStatus() == NetherDescriptorStatus::readOnly)
+		if(packetReadSize > (int)sizeof(packetBuffer))
+		{
+			netherNetlink->packetTruncated(packetBuffer, sizeof(packetBuffer));
+			return (1);
+		}
+
+		/* try to process the packet using netfilter_queue library, fetch packet info
+		    needed for making a decision about it */
+		if(netherNetlink->processPacket(packetBuffer, packetReadSize, monotonicTime()))
 		{
-			FD_SET(backendDescriptor, &watchedReadDescriptorsSet);
+			return (1);
 		}
 		else
-			if(netherPrimaryPolicyBackend->getDescriptorStatus() == NetherDescriptorStatus::readWrite)
-			{
-				FD_SET(backendDescriptor, &watchedReadDescriptorsSet);
-				FD_SET(backendDescriptor, &watchedWriteDescriptorsSet);
-			}
+		{
+			/* if we can't process the incoming packets, it's bad. Let's exit now */
+			LOGE("Failed to process netlink received packet, refusing to continue");
+			return (-1);
+		}
+	}
+
+	if(packetReadSize < 0 && errno == ENOBUFS)
+	{
+		netherNetlink->receiveBufferFull();
+		return (0);
 	}
 
-	timeoutSpecification.tv_sec     = 240;
-	timeoutSpecification.tv_usec    = 0;
+	LOGE("NetherManager::process recv failed " << strerror(errno));
+	return (-1);
 }
 
 NetherConfig &NetherManager::getConfig()
@@ -263,6 +843,21 @@ NetherConfig &NetherManager::getConfig()
 	return (netherConfig);
 }
 
+uint64_t NetherManager::getPacketsReceived() const
+{
+	return (metrics.packetsReceived.get());
+}
+
+const NetherMetrics &NetherManager::getMetrics() const
+{
+	return (metrics);
+}
+
+const NetherPacketLatency *NetherManager::getPacketLatency() const
+{
+	return (packetLatency.get());
+}
+
 NetherPolicyBackend *NetherManager::getPolicyBackend(const NetherConfig &netherConfig, const bool primary)
 {
 	switch(primary ? netherConfig.primaryBackendType : netherConfig.backupBackendType)
@@ -281,11 +876,44 @@ NetherPolicyBackend *NetherManager::getPolicyBackend(const NetherConfig &netherC
 	}
 }
 
-bool NetherManager::verdictCast(const u_int32_t packetId, const NetherVerdict verdict, int mark)
+bool NetherManager::verdictCast(const u_int32_t packetId, const NetherVerdict verdict, int mark, const NetherVerdictPath path)
 {
+	NetherInFlightPacket *inFlight;
+	NetherPendingDecision *pendingDecision;
+
+	if((inFlight = findInFlightPacket(packetId)) != nullptr)
+	{
+		if(!inFlight->hedged)
+		{
+			metrics.verdictsInTime.add();
+			releaseInFlightPacket(*inFlight);
+		}
+		else if(inFlight->decided)
+		{
+			/* the other backend was faster, the packet is gone already */
+			LOGD("Dropping late verdict for hedged packet " << packetId);
+			metrics.lateVerdictsDropped.add();
+			releaseInFlightPacket(*inFlight);
+			return (true);
+		}
+		else
+		{
+			inFlight->decided = true;
+		}
+	}
+
+	/* only decisions of the primary backend are remembered */
+	if((pendingDecision = findPendingDecision(packetId)) != nullptr)
+	{
+		if(path != NetherVerdictPath::fallback)
+			decisionCache->insert(pendingDecision->key, NetherDecision{verdict, mark});
+		pendingDecision->inUse = false;
+	}
+
 	if(netherNetlink)
 	{
 		netherNetlink->setVerdict(packetId, verdict, mark);
+		packetLatency->packetDecided(packetId, verdict, path, monotonicTime());
 	}
 	else
 	{
@@ -300,27 +928,200 @@ void NetherManager::packetReceived(const NetherPacket &packet)
 {
 	LOGD(packetToString(packet).c_str());
 
-	if(netherPrimaryPolicyBackend && netherPrimaryPolicyBackend->enqueueVerdict(packet))
+	metrics.packetsReceived.add();
+
+	if(decisionCache)
 	{
-		LOGD("Primary policy accepted packet");
-		return;
+		NetherDecisionKey decisionKey{packet.securityContext, packet.uid, packet.gid};
+		NetherDecision decision;
+
+		if(decisionCache->lookup(decisionKey, decision))
+		{
+			LOGD("Decision cache hit");
+			metrics.decisionCacheHits.add();
+			packetLatency->packetReceived(packet.id, packet.receivedAt, NetherLatencySource::decisionCache);
+			verdictCast(packet.id, decision.verdict, decision.mark, NetherVerdictPath::policy);
+			return;
+		}
+
+		metrics.decisionCacheMisses.add();
 	}
 
-	if(netherBackupPolicyBackend && netherBackupPolicyBackend->enqueueVerdict(packet))
+	packetLatency->packetReceived(packet.id, packet.receivedAt, NetherPacketLatency::getSource(netherConfig.primaryBackendType));
+
+	/* while the primary backend keeps failing, don't pay for
+		the failure on every packet, go to the backup backend */
+	if(primaryBreaker.allowRequest())
 	{
-		LOGI("Primary policy backend failed, using backup policy backend");
-		return;
+		NetherPendingDecision *pendingDecision;
+		NetherInFlightPacket *inFlight;
+
+		/* the backend might answer before enqueueVerdict() returns */
+		if(decisionCache)
+		{
+			pendingDecisions[packet.id & (NETHER_PENDING_RING_SIZE - 1)] =
+				NetherPendingDecision{packet.id, true, NetherDecisionKey{packet.securityContext, packet.uid, packet.gid}};
+		}
+
+		if(netherConfig.hedgeDelay > 0)
+		{
+			NetherInFlightPacket &inFlightSlot = inFlightPackets[packet.id & (NETHER_PENDING_RING_SIZE - 1)];
+
+			if(!inFlightSlot.inUse)
+				inFlightCount++;
+
+			inFlightSlot = NetherInFlightPacket{packet, false, false, true};
+			hedgeDeadlines.emplace_back(packet.id, std::chrono::steady_clock::now() + std::chrono::milliseconds(netherConfig.hedgeDelay));
+		}
+
+		if(netherPrimaryPolicyBackend->enqueueVerdict(packet))
+		{
+			LOGD("Primary policy accepted packet");
+			primaryBreaker.recordSuccess();
+			return;
+		}
+
+		/* a burst that fills the backend up is not a failure, the
+			next packets can still be answered by it (from it's cache) */
+		if(netherPrimaryPolicyBackend->isOverloaded())
+			primaryBreaker.recordBusy();
+		else
+			primaryBreaker.recordFailure();
+
+		if((pendingDecision = findPendingDecision(packet.id)) != nullptr)
+			pendingDecision->inUse = false;
+
+		if((inFlight = findInFlightPacket(packet.id)) != nullptr)
+			releaseInFlightPacket(*inFlight);
+
+		LOGI_RATELIMITED("Primary policy backend failed, using backup policy backend");
+	}
+	else
+	{
+		metrics.primaryDiverted.add();
 	}
 
+	metrics.backupFallbacks.add();
+
+	if(enqueueBackupVerdict(packet))
+		return;
+
 	/* In this situation no policy backend wants to deal with this packet
 	    there propably isn't any rule in either of them
 
 	    we need to make a generic decision based on whatever is hard-coded
 	    or passed as a parameter to the service */
-	LOGW("All policy backends failed, using DUMMY backend");
+	LOGW_RATELIMITED("All policy backends failed, using DUMMY backend");
+	metrics.dummyFallbacks.add();
+	packetLatency->setSource(packet.id, NetherLatencySource::fallback);
 	netherFallbackPolicyBackend->enqueueVerdict(packet);
 }
 
+bool NetherManager::enqueueBackupVerdict(const NetherPacket &packet)
+{
+	if(!backupBreaker.allowRequest())
+	{
+		metrics.backupDiverted.add();
+		return (false);
+	}
+
+	/* a hedged packet answered by the primary backend after all is
+		still counted for the backup backend */
+	packetLatency->setSource(packet.id, NetherPacketLatency::getSource(netherConfig.backupBackendType));
+
+	if(netherBackupPolicyBackend->enqueueVerdict(packet))
+	{
+		backupBreaker.recordSuccess();
+		return (true);
+	}
+
+	if(netherBackupPolicyBackend->isOverloaded())
+		backupBreaker.recordBusy();
+	else
+		backupBreaker.recordFailure();
+
+	return (false);
+}
+
+/* Packets the primary backend did not answer within the hedge delay
+	are given to the backup backend, whichever answers first decides */
+void NetherManager::hedgeSlowPackets()
+{
+	const auto now = std::chrono::steady_clock::now();
+
+	while(!hedgeDeadlines.empty() && hedgeDeadlines.front().second <= now)
+	{
+		const u_int32_t packetId		= hedgeDeadlines.front().first;
+		NetherInFlightPacket *inFlight	= findInFlightPacket(packetId);
+		NetherPendingDecision *pendingDecision;
+
+		hedgeDeadlines.pop_front();
+
+		if(inFlight == nullptr || inFlight->hedged)
+			continue;
+
+		const NetherPacket packet	= inFlight->packet;
+		inFlight->hedged			= true;
+		metrics.packetsHedged.add();
+		lateVerdictDeadlines.emplace_back(packetId, now + std::chrono::seconds(NETHER_HEDGE_LATE_VERDICT_WAIT));
+
+		/* the backup backend's answer is not a decision to cache */
+		if((pendingDecision = findPendingDecision(packetId)) != nullptr)
+			pendingDecision->inUse = false;
+
+		LOGD("Primary policy backend too slow for packet " << packetId << ", hedging with backup policy backend");
+
+		if(!enqueueBackupVerdict(packet))
+		{
+			packetLatency->setSource(packetId, NetherLatencySource::fallback);
+			netherFallbackPolicyBackend->enqueueVerdict(packet);
+		}
+	}
+
+	/* a backend that never answers the losing request must not make us grow */
+	while(!lateVerdictDeadlines.empty() && lateVerdictDeadlines.front().second <= now)
+	{
+		NetherInFlightPacket *inFlight = findInFlightPacket(lateVerdictDeadlines.front().first);
+
+		if(inFlight != nullptr)
+			releaseInFlightPacket(*inFlight);
+
+		lateVerdictDeadlines.pop_front();
+	}
+}
+
+NetherPendingDecision *NetherManager::findPendingDecision(const u_int32_t packetId)
+{
+	if(pendingDecisions.empty())
+		return (nullptr);
+
+	NetherPendingDecision &pendingDecision = pendingDecisions[packetId & (NETHER_PENDING_RING_SIZE - 1)];
+
+	if(!pendingDecision.inUse || pendingDecision.packetId != packetId)
+		return (nullptr);
+
+	return (&pendingDecision);
+}
+
+NetherInFlightPacket *NetherManager::findInFlightPacket(const u_int32_t packetId)
+{
+	if(inFlightPackets.empty())
+		return (nullptr);
+
+	NetherInFlightPacket &inFlight = inFlightPackets[packetId & (NETHER_PENDING_RING_SIZE - 1)];
+
+	if(!inFlight.inUse || inFlight.packet.id != packetId)
+		return (nullptr);
+
+	return (&inFlight);
+}
+
+void NetherManager::releaseInFlightPacket(NetherInFlightPacket &inFlight)
+{
+	inFlight.inUse = false;
+	inFlightCount--;
+}
+
 bool NetherManager::restoreRules()
 {
 	if(!isCommandAvailable(netherConfig.iptablesRestorePath))
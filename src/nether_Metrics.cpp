@@ -0,0 +1,348 @@
+/*
+ *  Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Roman Kubiak (r.kubiak@samsung.com)
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+
+/**
+ * @file
+ * @author  Roman Kubiak (r.kubiak@samsung.com)
+ * @brief   Metrics of the queue threads and the socket they are read from
+ */
+
+#include "nether_Metrics.h"
+#include "nether_Utils.h"
+
+#include <fcntl.h>
+#include <map>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+static const NetherVerdict metricsVerdicts[] = { NetherVerdict::allow, NetherVerdict::allowAndLog, NetherVerdict::deny };
+
+static const std::pair<const char *, NetherCircuitMetrics NetherMetrics::*> metricsCircuits[] =
+{
+	{ "primary", &NetherMetrics::primaryCircuit },
+	{ "backup", &NetherMetrics::backupCircuit }
+};
+
+static void describeMetric(std::ostream &text, const char *name, const char *type, const char *help)
+{
+	text << "# HELP " << name << " " << help << "\n"
+		 << "# TYPE " << name << " " << type << "\n";
+}
+
+static void writeMetric(std::ostream &text, const char *name, const char *type, const char *help, const uint64_t value)
+{
+	describeMetric(text, name, type, help);
+	text << name << " " << value << "\n";
+}
+
+NetherVerdictCounters::NetherVerdictCounters()
+{
+	for(auto &verdictUsed : used)
+		verdictUsed.store(0, std::memory_order_relaxed);
+}
+
+uint32_t NetherVerdictCounters::getMarks(const NetherVerdict verdict) const
+{
+	return (used[(size_t)verdict].load(std::memory_order_acquire));
+}
+
+int32_t NetherVerdictCounters::getMark(const NetherVerdict verdict, const uint32_t index) const
+{
+	return (marks[(size_t)verdict][index]);
+}
+
+uint64_t NetherVerdictCounters::getCount(const NetherVerdict verdict, const uint32_t index) const
+{
+	return (counts[(size_t)verdict][index].get());
+}
+
+uint64_t NetherVerdictCounters::getOtherMarks(const NetherVerdict verdict) const
+{
+	return (otherMarks[(size_t)verdict].get());
+}
+
+NetherMetricsServer::NetherMetricsServer(const std::string &_socketPath)
+	: socketPath(_socketPath), kernelQueue(nullptr), listenDescriptor(-1)
+{
+}
+
+NetherMetricsServer::~NetherMetricsServer()
+{
+	if(listenDescriptor != -1)
+	{
+		close(listenDescriptor);
+		unlink(socketPath.c_str());
+	}
+}
+
+bool NetherMetricsServer::initialize()
+{
+	struct sockaddr_un address;
+
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+
+	if(socketPath.size() >= sizeof(address.sun_path))
+	{
+		LOGE("Metrics socket path is too long: " << socketPath);
+		return (false);
+	}
+
+	strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+	if((listenDescriptor = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) == -1)
+	{
+		LOGE("Failed to create metrics socket: " << strerror(errno));
+		return (false);
+	}
+
+	/* left behind by a nether that did not stop cleanly */
+	unlink(socketPath.c_str());
+
+	if(bind(listenDescriptor, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+			chmod(socketPath.c_str(), 0660) != 0 ||
+			listen(listenDescriptor, NETHER_METRICS_CLIENTS) != 0)
+	{
+		LOGE("Failed to listen on metrics socket: " << socketPath << " " << strerror(errno));
+		close(listenDescriptor);
+		listenDescriptor = -1;
+		return (false);
+	}
+
+	LOGI("Metrics available on: " << socketPath);
+	return (true);
+}
+
+int NetherMetricsServer::getDescriptor() const
+{
+	return (listenDescriptor);
+}
+
+void NetherMetricsServer::addShard(const int queueNumber, const NetherMetrics *metrics, const NetherPacketLatency *packetLatency)
+{
+	shards.push_back(NetherMetricsShard{queueNumber, metrics, packetLatency});
+}
+
+void NetherMetricsServer::setKernelQueue(const NetherKernelQueue *_kernelQueue)
+{
+	kernelQueue = _kernelQueue;
+}
+
+/* The text is small enough to fit in the socket buffer, if a client
+	does not take it at once it gets nothing, the event loop never waits */
+int NetherMetricsServer::handleClients(const int budget)
+{
+	int clients = 0;
+
+	while(clients < budget)
+	{
+		const int clientDescriptor = accept4(listenDescriptor, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+		if(clientDescriptor == -1)
+		{
+			if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+				LOGW_RATELIMITED("Failed to accept metrics client: " << strerror(errno));
+			break;
+		}
+
+		const std::string text	= getText();
+		const ssize_t sent		= send(clientDescriptor, text.data(), text.size(), MSG_NOSIGNAL);
+
+		if(sent != (ssize_t)text.size())
+			LOGW_RATELIMITED("Failed to send metrics: " << (sent < 0 ? strerror(errno) : "client too slow"));
+
+		close(clientDescriptor);
+		clients++;
+	}
+
+	return (clients);
+}
+
+uint64_t NetherMetricsServer::sum(NetherCounter NetherMetrics::*counter) const
+{
+	uint64_t total = 0;
+
+	for(auto &shard : shards)
+		total += (shard.metrics->*counter).get();
+
+	return (total);
+}
+
+uint64_t NetherMetricsServer::sum(NetherCircuitMetrics NetherMetrics::*circuit, NetherCounter NetherCircuitMetrics::*counter) const
+{
+	uint64_t total = 0;
+
+	for(auto &shard : shards)
+		total += (shard.metrics->*circuit.*counter).get();
+
+	return (total);
+}
+
+std::string NetherMetricsServer::getText() const
+{
+	std::map<std::pair<NetherVerdict, int32_t>, uint64_t> verdicts;
+	std::unique_ptr<NetherLatencyHistogram[]> latency(new NetherLatencyHistogram[NETHER_LATENCY_SOURCES * NETHER_LATENCY_VERDICTS]);
+	std::stringstream text;
+
+	writeMetric(text, "nether_packets_received_total", "counter", "Packets read from the netfilter queues.", sum(&NetherMetrics::packetsReceived));
+
+	describeMetric(text, "nether_queue_packets_received_total", "counter", "Packets read from each netfilter queue.");
+	for(auto &shard : shards)
+	{
+		if(shard.queueNumber >= 0)
+			text << "nether_queue_packets_received_total{queue=\"" << shard.queueNumber << "\"} " << shard.metrics->packetsReceived.get() << "\n";
+	}
+
+	/* the same mark can have a different counter index in each thread */
+	for(auto &shard : shards)
+	{
+		for(auto verdict : metricsVerdicts)
+		{
+			const uint32_t marks = shard.metrics->verdicts.getMarks(verdict);
+
+			for(uint32_t index = 0; index < marks; index++)
+				verdicts[std::make_pair(verdict, shard.metrics->verdicts.getMark(verdict, index))] += shard.metrics->verdicts.getCount(verdict, index);
+
+			if(shard.metrics->verdicts.getOtherMarks(verdict))
+				verdicts[std::make_pair(verdict, INT32_MIN)] += shard.metrics->verdicts.getOtherMarks(verdict);
+		}
+	}
+
+	describeMetric(text, "nether_verdicts_total", "counter", "Verdicts sent to the kernel by verdict and packet mark.");
+	for(auto &verdict : verdicts)
+	{
+		text << "nether_verdicts_total{verdict=\"" << verdictToString(verdict.first.first) << "\",mark=\"";
+
+		if(verdict.first.second == INT32_MIN)
+			text << "other";
+		else if(verdict.first.second < 0)
+			text << "none";
+		else
+			text << verdict.first.second;
+
+		text << "\"} " << verdict.second << "\n";
+	}
+
+	writeMetric(text, "nether_netlink_enobufs_total", "counter",
+				"Times the netlink socket buffer overflowed and the kernel dropped packets.", sum(&NetherMetrics::receiveBuffersFull));
+
+	describeMetric(text, "nether_backend_fallbacks_total", "counter", "Packets the primary policy backend did not decide about.");
+	text << "nether_backend_fallbacks_total{backend=\"backup\"} " << sum(&NetherMetrics::backupFallbacks) << "\n"
+		 << "nether_backend_fallbacks_total{backend=\"dummy\"} " << sum(&NetherMetrics::dummyFallbacks) << "\n";
+
+	describeMetric(text, "nether_circuit_diverted_total", "counter", "Packets not given to a policy backend while it's circuit was open.");
+	text << "nether_circuit_diverted_total{backend=\"primary\"} " << sum(&NetherMetrics::primaryDiverted) << "\n"
+		 << "nether_circuit_diverted_total{backend=\"backup\"} " << sum(&NetherMetrics::backupDiverted) << "\n";
+
+	describeMetric(text, "nether_circuit_opened_total", "counter", "Times the circuit of a policy backend opened.");
+	for(auto &circuit : metricsCircuits)
+		text << "nether_circuit_opened_total{backend=\"" << circuit.first << "\"} " << sum(circuit.second, &NetherCircuitMetrics::opened) << "\n";
+
+	describeMetric(text, "nether_circuit_probes_total", "counter", "Packets given to a policy backend with an open circuit to see if it recovered.");
+	for(auto &circuit : metricsCircuits)
+		text << "nether_circuit_probes_total{backend=\"" << circuit.first << "\"} " << sum(circuit.second, &NetherCircuitMetrics::probes) << "\n";
+
+	describeMetric(text, "nether_circuit_closed_total", "counter", "Times the circuit of a policy backend closed after it recovered.");
+	for(auto &circuit : metricsCircuits)
+		text << "nether_circuit_closed_total{backend=\"" << circuit.first << "\"} " << sum(circuit.second, &NetherCircuitMetrics::closed) << "\n";
+
+	/* every queue thread has it's own circuit breakers */
+	describeMetric(text, "nether_circuit_state", "gauge", "State of the circuit of a policy backend, 0 closed, 1 open, 2 half-open.");
+	for(auto &shard : shards)
+	{
+		if(shard.queueNumber < 0)
+			continue;
+
+		for(auto &circuit : metricsCircuits)
+			text << "nether_circuit_state{backend=\"" << circuit.first << "\",queue=\"" << shard.queueNumber << "\"} "
+				 << (shard.metrics->*circuit.second).state.get() << "\n";
+	}
+
+	writeMetric(text, "nether_decision_cache_hits_total", "counter", "Packets decided by the decision cache.", sum(&NetherMetrics::decisionCacheHits));
+	writeMetric(text, "nether_decision_cache_misses_total", "counter", "Packets the decision cache had no decision for.", sum(&NetherMetrics::decisionCacheMisses));
+	writeMetric(text, "nether_hedge_verdicts_in_time_total", "counter", "Primary backend verdicts that came before the hedge delay.", sum(&NetherMetrics::verdictsInTime));
+	writeMetric(text, "nether_hedged_packets_total", "counter", "Packets given to the backup backend after the hedge delay.", sum(&NetherMetrics::packetsHedged));
+	writeMetric(text, "nether_late_verdicts_dropped_total", "counter", "Verdicts for hedged packets that were already decided.", sum(&NetherMetrics::lateVerdictsDropped));
+	writeMetric(text, "nether_cynara_cache_hits_total", "counter", "Cynara checks answered by the client cache.", sum(&NetherMetrics::cynaraCacheHits));
+	writeMetric(text, "nether_cynara_cache_misses_total", "counter", "Cynara checks that needed the Cynara server.", sum(&NetherMetrics::cynaraCacheMisses));
+	writeMetric(text, "nether_cynara_pending_checks", "gauge", "Cynara checks waiting for an answer.", sum(&NetherMetrics::cynaraPendingChecks));
+	writeMetric(text, "nether_reloads_total", "counter", "Policy reloads (SIGHUP).", sum(&NetherMetrics::reloads));
+	writeMetric(text, "nether_kernel_queue_depth_warnings_total", "counter",
+				"Times the packets waiting in a kernel queue reached the warning threshold.", sum(&NetherMetrics::queueDepthWarnings));
+
+	if(kernelQueue)
+	{
+		describeMetric(text, "nether_kernel_queue_pending", "gauge", "Packets waiting in the kernel queue for a verdict.");
+		for(auto &status : kernelQueue->getStatus())
+		{
+			if(status.seen)
+				text << "nether_kernel_queue_pending{queue=\"" << status.queueNumber << "\"} " << status.pending << "\n";
+		}
+
+		describeMetric(text, "nether_kernel_queue_dropped", "gauge", "Packets the kernel dropped because the queue was full.");
+		for(auto &status : kernelQueue->getStatus())
+		{
+			if(status.seen)
+				text << "nether_kernel_queue_dropped{queue=\"" << status.queueNumber << "\"} " << status.queueDropped << "\n";
+		}
+
+		describeMetric(text, "nether_kernel_queue_user_dropped", "gauge", "Packets the kernel dropped because the netlink socket buffer was full.");
+		for(auto &status : kernelQueue->getStatus())
+		{
+			if(status.seen)
+				text << "nether_kernel_queue_user_dropped{queue=\"" << status.queueNumber << "\"} " << status.userDropped << "\n";
+		}
+	}
+
+	writeMetric(text, "nether_log_messages_dropped_total", "counter", "Log messages dropped by a full log queue.", logger::Logger::getDropped());
+
+	for(auto &shard : shards)
+	{
+		if(!shard.packetLatency)
+			continue;
+
+		for(uint32_t source = 0; source < NETHER_LATENCY_SOURCES; source++)
+			for(auto verdict : metricsVerdicts)
+				latency[source * NETHER_LATENCY_VERDICTS + (size_t)verdict].add(shard.packetLatency->getHistogram((NetherLatencySource)source, verdict));
+	}
+
+	describeMetric(text, "nether_packet_latency_seconds", "summary", "Time from reading a packet to casting it's verdict.");
+	for(uint32_t source = 0; source < NETHER_LATENCY_SOURCES; source++)
+	{
+		for(auto verdict : metricsVerdicts)
+		{
+			const NetherLatencyHistogram &histogram = latency[source * NETHER_LATENCY_VERDICTS + (size_t)verdict];
+			std::stringstream labels;
+
+			if(histogram.getCount() == 0)
+				continue;
+
+			labels << "source=\"" << NetherPacketLatency::sourceToString((NetherLatencySource)source)
+				   << "\",verdict=\"" << verdictToString(verdict) << "\"";
+
+			for(auto quantile : {0.5, 0.99, 0.999})
+				text << "nether_packet_latency_seconds{" << labels.str() << ",quantile=\"" << quantile << "\"} "
+					 << histogram.getPercentile(quantile * 100) / 1e9 << "\n";
+
+			text << "nether_packet_latency_seconds_sum{" << labels.str() << "} " << histogram.getSum() / 1e9 << "\n"
+				 << "nether_packet_latency_seconds_count{" << labels.str() << "} " << histogram.getCount() << "\n";
+		}
+	}
+
+	return (text.str());
+}
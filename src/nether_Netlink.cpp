@@ -24,9 +24,21 @@
 
 #include "nether_Netlink.h"
 
+#include <algorithm>
+#include <fcntl.h>
+
 NetherNetlink::NetherNetlink(NetherConfig &netherConfig)
-	: NetherPacketProcessor(netherConfig), queueHandle(nullptr), nfqHandle(nullptr), nlif(nullptr), queue(netherConfig.queueNumber)
+	: NetherPacketProcessor(netherConfig), queueHandle(nullptr), nfqHandle(nullptr), nlif(nullptr), queue(netherConfig.queueNumber),
+	  packetReceivedAt(0), receiveBufferSize(0), receiveMessageSize(0), metrics(nullptr), undecidedOldest(0), undecidedNext(0), verdictBufferLength(0), verdictSequence(0), verdictsIssued(0), verdictSyscalls(0)
 {
+	if(netherConfig.batchVerdicts || netherConfig.connmarkVerdicts)
+	{
+		verdictBuffer.resize(NETHER_VERDICT_BUFFER_SIZE);
+		pendingVerdicts.reserve(NETHER_VERDICT_BUFFER_SIZE / NETHER_VERDICT_MESSAGE_SIZE);
+	}
+
+	if(netherConfig.batchVerdicts)
+		undecidedPackets.resize(NETHER_UNDECIDED_WINDOW / 64, 0);
 }
 
 NetherNetlink::~NetherNetlink()
@@ -37,6 +49,8 @@ NetherNetlink::~NetherNetlink()
 
 bool NetherNetlink::initialize()
 {
+	bool securityContexts = true;
+
 	nfqHandle = nfq_open();
 
 	if(!nfqHandle)
@@ -66,22 +80,99 @@ bool NetherNetlink::initialize()
 	}
 
 	if(nfq_set_queue_flags(queueHandle, NFQA_CFG_F_SECCTX, NFQA_CFG_F_SECCTX))
+	{
 		LOGI("This kernel version does not allow to retrieve security context");
+		securityContexts = false;
+	}
 
-	if(nfq_set_mode(queueHandle, netherConfig.copyPackets ? NFQNL_COPY_PACKET : NFQNL_COPY_META, 0xffff) < 0)
+	/* the decoders only read the headers, the rest of the packet is never copied */
+	if(nfq_set_mode(queueHandle, netherConfig.copyPackets ? NFQNL_COPY_PACKET : NFQNL_COPY_META, NETHER_COPY_RANGE) < 0)
 	{
 		LOGE("Can't set packet_copy mode");
-		nfq_destroy_queue(queueHandle);
+		destroyQueue();
 		return (false);
 	}
 
 	if(nfq_set_queue_flags(queueHandle, NFQA_CFG_F_UID_GID, NFQA_CFG_F_UID_GID))
 	{
 		LOGE("This kernel version does not allow to retrieve process UID/GID");
-		nfq_destroy_queue(queueHandle);
+		destroyQueue();
 		return (false);
 	}
 
+	if(netherConfig.connmarkVerdicts && nfq_set_queue_flags(queueHandle, NFQA_CFG_F_CONNTRACK, NFQA_CFG_F_CONNTRACK))
+	{
+		LOGE("This kernel version does not allow to access conntrack information, can't use connmark verdicts");
+		destroyQueue();
+		return (false);
+	}
+
+	if(netherConfig.queueMaxLength > 0 && nfq_set_queue_maxlen(queueHandle, netherConfig.queueMaxLength) < 0)
+	{
+		LOGE("Can't set the queue max length to " << netherConfig.queueMaxLength);
+		destroyQueue();
+		return (false);
+	}
+
+	/* the kernel accepts packets that don't fit in the queue or the
+		socket buffer, instead of dropping them */
+	if(netherConfig.failOpen && nfq_set_queue_flags(queueHandle, NFQA_CFG_F_FAIL_OPEN, NFQA_CFG_F_FAIL_OPEN))
+	{
+		LOGE("This kernel version does not allow to fail open");
+		destroyQueue();
+		return (false);
+	}
+
+	if(netherConfig.netlinkBufferSize > 0 && !setReceiveBuffer(netherConfig.netlinkBufferSize * 1024))
+	{
+		destroyQueue();
+		return (false);
+	}
+
+	if(netherConfig.noEnobufs)
+	{
+		int enabled = 1;
+
+		if(setsockopt(nfq_fd(nfqHandle), SOL_NETLINK, NETLINK_NO_ENOBUFS, &enabled, sizeof(enabled)) == -1)
+		{
+			LOGE("Can't disable ENOBUFS on the netlink socket: " << strerror(errno));
+			destroyQueue();
+			return (false);
+		}
+	}
+
+	if(netherConfig.receiveBatchSize > 0)
+	{
+		int flags = fcntl(nfq_fd(nfqHandle), F_GETFL);
+
+		if(flags == -1 || fcntl(nfq_fd(nfqHandle), F_SETFL, flags | O_NONBLOCK) == -1)
+		{
+			LOGE("Can't make the netlink socket non-blocking: " << strerror(errno));
+			destroyQueue();
+			return (false);
+		}
+
+		/* the security context and the conntrack attributes have no useful
+			upper limit, with them a message gets a whole page */
+		if(securityContexts || netherConfig.connmarkVerdicts)
+			receiveMessageSize = NETHER_PACKET_BUFFER_SIZE;
+		else
+			receiveMessageSize = NLMSG_ALIGN(NETHER_RECEIVE_MESSAGE_OVERHEAD + (netherConfig.copyPackets ? NETHER_COPY_RANGE : 0));
+
+		receiveBuffers.resize(netherConfig.receiveBatchSize * receiveMessageSize);
+		receiveVectors.resize(netherConfig.receiveBatchSize);
+		receiveMessages.resize(netherConfig.receiveBatchSize);
+
+		for(int message = 0; message < netherConfig.receiveBatchSize; message++)
+		{
+			receiveVectors[message].iov_base	= &receiveBuffers[message * receiveMessageSize];
+			receiveVectors[message].iov_len		= receiveMessageSize;
+			memset(&receiveMessages[message], 0, sizeof(struct mmsghdr));
+			receiveMessages[message].msg_hdr.msg_iov	= &receiveVectors[message];
+			receiveMessages[message].msg_hdr.msg_iovlen	= 1;
+		}
+	}
+
 	if (netherConfig.interfaceInfo)
 	{
 		nlif = nlif_open();
@@ -95,6 +186,52 @@ bool NetherNetlink::initialize()
 	return (true);
 }
 
+/* The queue is unbound from the kernel when initialize() fails after
+	creating it, the destructor does not destroy it a second time */
+void NetherNetlink::destroyQueue()
+{
+	nfq_destroy_queue(queueHandle);
+	queueHandle = nullptr;
+}
+
+/* SO_RCVBUFFORCE is not limited by net.core.rmem_max, but it needs
+	CAP_NET_ADMIN, the kernel doubles the size for it's own overhead */
+bool NetherNetlink::setReceiveBuffer(const int size)
+{
+	if(setsockopt(nfq_fd(nfqHandle), SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) == -1)
+	{
+		LOGW("Can't force the netlink buffer size (" << strerror(errno) << "), it will be limited by net.core.rmem_max");
+
+		if(setsockopt(nfq_fd(nfqHandle), SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)) == -1)
+		{
+			LOGE("Can't set the netlink buffer size: " << strerror(errno));
+			return (false);
+		}
+	}
+
+	receiveBufferSize = size;
+	return (true);
+}
+
+/* The kernel dropped packets because the socket buffer was full, the
+	error is reported once and cleared. Those packets never reached us, so
+	there is nothing waiting for them here, but the buffer was too small
+	for this burst, grow it if the size is ours to pick */
+void NetherNetlink::receiveBufferFull()
+{
+	const int maximumSize = std::min(NETHER_NETLINK_BUFFER_MAX / NETHER_NETLINK_BUFFER_GROWTH, netherConfig.netlinkBufferSize * 1024)
+							* NETHER_NETLINK_BUFFER_GROWTH;
+
+	if(metrics)
+		metrics->receiveBuffersFull.add();
+
+	LOGI_RATELIMITED("NetherNetlink losing packets! [bad things might happen]");
+
+	if(receiveBufferSize > 0 && receiveBufferSize < maximumSize &&
+			setReceiveBuffer(std::min(receiveBufferSize * 2, maximumSize)))
+		LOGI("Netlink buffer size increased to " << receiveBufferSize / 1024 << "KB");
+}
+
 int NetherNetlink::getDescriptor()
 {
 	if(nfqHandle)
@@ -104,8 +241,10 @@ int NetherNetlink::getDescriptor()
 	return (-1);
 }
 
-bool NetherNetlink::processPacket(char *packetBuffer, const int packetReadSize)
+bool NetherNetlink::processPacket(char *packetBuffer, const int packetReadSize, const uint64_t receivedAt)
 {
+	packetReceivedAt = receivedAt;
+
 	if(nfq_handle_packet(nfqHandle, packetBuffer, packetReadSize))
 	{
 		LOGE("nfq_handle_packet failed");
@@ -115,6 +254,98 @@ bool NetherNetlink::processPacket(char *packetBuffer, const int packetReadSize)
 	return (true);
 }
 
+int NetherNetlink::receivePackets(const int budget)
+{
+	int received = 0, requested, messages;
+
+	/* drain the socket until it would block, or we used up our budget
+		for this iteration, whatever comes first */
+	while(received < budget)
+	{
+		requested	= std::min(netherConfig.receiveBatchSize, budget - received);
+		messages	= recvmmsg(nfq_fd(nfqHandle), &receiveMessages[0], requested, MSG_DONTWAIT, NULL);
+
+		if(messages < 0)
+		{
+			if(errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+
+			if(errno == EINTR)
+				continue;
+
+			if(errno == ENOBUFS)
+			{
+				receiveBufferFull();
+				continue;
+			}
+
+			LOGE("NetherNetlink::receivePackets recvmmsg failed " << strerror(errno));
+			return (-1);
+		}
+
+		/* all packets of a batch arrived at the same time */
+		const uint64_t receivedAt = monotonicTime();
+
+		for(int message = 0; message < messages; message++)
+		{
+			if(receiveMessages[message].msg_hdr.msg_flags & MSG_TRUNC)
+			{
+				packetTruncated((char *)receiveVectors[message].iov_base, receiveMessages[message].msg_len);
+				continue;
+			}
+
+			if(!processPacket((char *)receiveVectors[message].iov_base, receiveMessages[message].msg_len, receivedAt))
+				return (-1);
+		}
+
+		received += messages;
+
+		if(messages < requested)
+			break;
+	}
+
+	return (received);
+}
+
+/* The message did not fit in the receive buffer (a security context
+	longer than a page), the packet header is the first attribute, so the
+	packet id is still there. No backend can decide about a packet we could
+	not read, it's denied instead of waiting in the queue forever */
+void NetherNetlink::packetTruncated(const char *packetBuffer, const int packetReadSize)
+{
+	const struct nlmsghdr *messageHeader = (const struct nlmsghdr *)packetBuffer;
+	int offset = NLMSG_HDRLEN + NLMSG_ALIGN(sizeof(struct nfgenmsg));
+
+	if(packetReadSize < NLMSG_HDRLEN || messageHeader->nlmsg_type != ((NFNL_SUBSYS_QUEUE << 8) | NFQNL_MSG_PACKET))
+	{
+		LOGE_RATELIMITED("Truncated netlink message that is not a packet");
+		return;
+	}
+
+	while(offset + NLA_HDRLEN <= packetReadSize)
+	{
+		const struct nlattr *attribute = (const struct nlattr *)&packetBuffer[offset];
+
+		if(attribute->nla_len < NLA_HDRLEN)
+			break;
+
+		if((attribute->nla_type & NLA_TYPE_MASK) == NFQA_PACKET_HDR &&
+				offset + NLA_HDRLEN + (int)sizeof(struct nfqnl_msg_packet_hdr) <= packetReadSize)
+		{
+			const struct nfqnl_msg_packet_hdr *packetHeader = (const struct nfqnl_msg_packet_hdr *)&packetBuffer[offset + NLA_HDRLEN];
+
+			LOGW_RATELIMITED("Netlink message of packet id=" << ntohl(packetHeader->packet_id)
+							 << " does not fit in " << packetReadSize << " bytes, denying it");
+			setVerdict(ntohl(packetHeader->packet_id), NetherVerdict::deny);
+			return;
+		}
+
+		offset += NLA_ALIGN(attribute->nla_len);
+	}
+
+	LOGE_RATELIMITED("Truncated netlink message without a packet id");
+}
+
 void NetherNetlink::getInterfaceInfo(struct nfq_data *nfa, NetherPacket &netherPacket)
 {
 	if (netherConfig.interfaceInfo)
@@ -143,14 +374,16 @@ int NetherNetlink::callback(struct nfq_q_handle *, struct nfgenmsg *, struct nfq
 	int secctxSize = 0;
 	struct nfqnl_msg_packet_hdr *ph;
 	unsigned char *payload;
+	int payloadSize;
 
 	if((ph = nfq_get_msg_packet_hdr(nfa)))
 	{
-		packet.id = ntohl(ph->packet_id);
+		packet.id			= ntohl(ph->packet_id);
+		packet.receivedAt	= me->packetReceivedAt;
 	}
 	else
 	{
-		LOGI("Failed to get packet id");
+		LOGI_RATELIMITED("Failed to get packet id");
 		return (1);
 	}
 
@@ -158,19 +391,24 @@ int NetherNetlink::callback(struct nfq_q_handle *, struct nfgenmsg *, struct nfq
 	me->getInterfaceInfo(nfa, packet);
 
 	if(nfq_get_uid(nfa, &packet.uid) == 0)
-		LOGW("Failed to get uid for packet id=" << packet.id);
+		LOGW_RATELIMITED("Failed to get uid for packet id=" << packet.id);
 
 	nfq_get_gid(nfa, &packet.gid);
 
 	secctxSize = nfq_get_secctx(nfa, &secctx);
 
 	if(secctxSize > 0)
-		packet.securityContext = std::string((char *)secctx, secctxSize);
+		packet.securityContext = NetherLabelTable::intern((char *)secctx, secctxSize);
 	else
 		LOGD("Failed to get security context for packet id=" << packet.id);
 
-	if(me->netherConfig.copyPackets && nfq_get_payload(nfa, &payload) > 0)
-		decodePacket(packet, payload);
+	if(me->netherConfig.copyPackets && (payloadSize = nfq_get_payload(nfa, &payload)) > 0)
+		decodePacket(packet, payload, payloadSize);
+
+	/* batched verdicts may only cover packets that were already decided
+		we need to know which ones are still waiting for a decision */
+	if(me->netherConfig.batchVerdicts)
+		me->packetUndecided(packet.id);
 
 	me->processNetherPacket(packet);  /* this call if from the NetherPacketProcessor class */
 
@@ -179,48 +417,309 @@ int NetherNetlink::callback(struct nfq_q_handle *, struct nfgenmsg *, struct nfq
 
 void NetherNetlink::setVerdict(const u_int32_t packetId, const NetherVerdict verdict, int32_t mark)
 {
-	int ret = 0;
+	NetherVerdictEntry entry;
 	LOGD("id=" << packetId << " verdict=" << verdictToString(verdict) << " mark=" << mark);
 
-	if(verdict == NetherVerdict::allow)
+	if(!getVerdictEntry(packetId, verdict, mark, entry))
+		return;
+
+	if(metrics)
+		metrics->verdicts.add(verdict, entry.mark);
+
+	if(netherConfig.batchVerdicts)
+	{
+		/* the verdict will be sent at the end of this event loop iteration */
+		packetDecided(packetId);
+		pendingVerdicts.push_back(entry);
+		return;
+	}
+
+	if(netherConfig.connmarkVerdicts)
+	{
+		/* the library can't set the conntrack mark, build the message ourselves */
+		pendingVerdicts.push_back(entry);
+		flushVerdicts();
+		return;
+	}
+
+	issueVerdict(entry);
+}
+
+bool NetherNetlink::getVerdictEntry(const u_int32_t packetId, const NetherVerdict verdict, int32_t mark, NetherVerdictEntry &entry)
+{
+	entry.packetId	= packetId;
+	entry.verdict	= NF_ACCEPT;
+
+	switch(verdict)
+	{
+		case NetherVerdict::allow:
+			entry.mark = mark >= 0 ? mark : -1;
+			return (true);
+
+		case NetherVerdict::deny:
+			/* if we're relaxed, let's not stress out */
+			/* if we get a mark from the verdict caster */
+			/* let's use it, maybe it knows better */
+			entry.mark = mark > 0 ? mark : (netherConfig.relaxed ? netherConfig.markAllowAndLog : netherConfig.markDeny);
+			return (true);
+
+		case NetherVerdict::allowAndLog:
+			entry.mark = netherConfig.markAllowAndLog;
+			return (true);
+
+		default:
+			return (false);
+	}
+}
+
+void NetherNetlink::issueVerdict(const NetherVerdictEntry &entry)
+{
+	int ret;
+
+	if(entry.mark >= 0)
+		ret = nfq_set_verdict2(queueHandle, entry.packetId, entry.verdict, entry.mark, 0, NULL);
+	else
+		ret = nfq_set_verdict(queueHandle, entry.packetId, entry.verdict, 0, NULL);
+
+	verdictsIssued++;
+	verdictSyscalls++;
+
+	if(ret == -1)
+		LOGW_RATELIMITED("can't set verdict for packetId=" << entry.packetId);
+}
+
+/* The kernel numbers the packets of a queue one after the other, a window
+	of bits after the oldest undecided packet tells which ones still wait */
+void NetherNetlink::packetUndecided(const u_int32_t packetId)
+{
+	if(undecidedOldest == undecidedNext)
+		undecidedOldest = undecidedNext = packetId;
+
+	/* A packet that waited for it's verdict longer than the window can't be
+		told apart from newer ones anymore, and would keep every following
+		verdict out of a batch. It gets the default verdict */
+	while((u_int32_t)(packetId - undecidedOldest) >= NETHER_UNDECIDED_WINDOW)
+	{
+		const u_int32_t oldestBit = undecidedOldest & (NETHER_UNDECIDED_WINDOW - 1);
+
+		if(undecidedPackets[oldestBit / 64] & (1ULL << (oldestBit % 64)))
+		{
+			LOGW_RATELIMITED("packet id=" << undecidedOldest << " has no verdict after " << NETHER_UNDECIDED_WINDOW
+							 << " newer packets, using the default verdict");
+			setVerdict(undecidedOldest, netherConfig.defaultVerdict);
+		}
+
+		undecidedOldest++;
+	}
+
+	const u_int32_t bit = packetId & (NETHER_UNDECIDED_WINDOW - 1);
+	undecidedPackets[bit / 64] |= 1ULL << (bit % 64);
+
+	if((int32_t)(packetId + 1 - undecidedNext) > 0)
+		undecidedNext = packetId + 1;
+}
+
+void NetherNetlink::packetDecided(const u_int32_t packetId)
+{
+	const u_int32_t bit = packetId & (NETHER_UNDECIDED_WINDOW - 1);
+
+	if((u_int32_t)(packetId - undecidedOldest) < (u_int32_t)(undecidedNext - undecidedOldest))
+		undecidedPackets[bit / 64] &= ~(1ULL << (bit % 64));
+}
+
+/* every packet is passed once, so this costs nothing per packet over time */
+bool NetherNetlink::getLowestUndecided(u_int32_t &packetId)
+{
+	while(undecidedOldest != undecidedNext)
 	{
-		if (mark >= 0)
+		const u_int32_t bit = undecidedOldest & (NETHER_UNDECIDED_WINDOW - 1);
+
+		if(undecidedPackets[bit / 64] & (1ULL << (bit % 64)))
 		{
-			ret = nfq_set_verdict2(queueHandle,
-								packetId,
-								NF_ACCEPT,
-								mark,
-								0,
-								NULL);
+			packetId = undecidedOldest;
+			return (true);
 		}
+
+		undecidedOldest++;
+	}
+
+	return (false);
+}
+
+/* The kernel applies a batch verdict to every queued packet up to it's id,
+	comparing ids the way they wrap (nfq_id_after()), so the run must end
+	before the first undecided packet in that order, not in raw id order */
+size_t NetherNetlink::getBatchEnd(const std::vector<NetherVerdictEntry> &entries, const size_t entry, size_t runEnd,
+								  const bool haveUndecided, const u_int32_t lowestUndecided)
+{
+	if(!haveUndecided)
+		return (runEnd);
+
+	while(runEnd > entry + 1 && (int32_t)(entries[runEnd - 1].packetId - lowestUndecided) >= 0)
+		runEnd--;
+
+	return (runEnd);
+}
+
+void NetherNetlink::flushVerdicts()
+{
+	size_t firstEntry = 0, runEnd;
+	u_int32_t lowestUndecided = 0;
+	bool haveUndecided, canBatch;
+
+	if(pendingVerdicts.empty())
+		return;
+
+	std::sort(pendingVerdicts.begin(), pendingVerdicts.end(),
+			  [](const NetherVerdictEntry &a, const NetherVerdictEntry &b) { return (a.packetId < b.packetId); });
+
+	/* a batch verdict applies to every queued packet with an id lower or equal
+		to the one given, so it can only be used below the first packet
+		that still waits for a decision. Don't try to batch across an id wrap */
+	haveUndecided	= getLowestUndecided(lowestUndecided);
+	canBatch		= (pendingVerdicts.back().packetId - pendingVerdicts.front().packetId) < 0x80000000;
+
+	/* batch verdicts can't carry the conntrack mark */
+	if(netherConfig.connmarkVerdicts)
+		canBatch = false;
+
+	verdictBufferLength = 0;
+
+	for(size_t entry = 0; entry < pendingVerdicts.size(); entry = runEnd)
+	{
+		runEnd = entry + 1;
+
+		while(runEnd < pendingVerdicts.size() &&
+				pendingVerdicts[runEnd].verdict == pendingVerdicts[entry].verdict &&
+				pendingVerdicts[runEnd].mark == pendingVerdicts[entry].mark)
+			runEnd++;
+
+		/* only the part of the run below the first undecided packet can be batched */
+		if(!canBatch)
+			runEnd = entry + 1;
 		else
+			runEnd = getBatchEnd(pendingVerdicts, entry, runEnd, haveUndecided, lowestUndecided);
+
+		if(verdictBufferLength + NETHER_VERDICT_MESSAGE_SIZE > verdictBuffer.size())
 		{
-			ret = nfq_set_verdict(queueHandle,
-								packetId,
-								NF_ACCEPT,
-								0,
-								NULL);
+			sendVerdictMessages(firstEntry, entry);
+			firstEntry = entry;
 		}
+
+		appendVerdictMessage(runEnd - entry > 1 ? pendingVerdicts[runEnd - 1] : pendingVerdicts[entry], runEnd - entry > 1);
+	}
+
+	sendVerdictMessages(firstEntry, pendingVerdicts.size());
+	pendingVerdicts.clear();
+}
+
+void NetherNetlink::appendVerdictMessage(const NetherVerdictEntry &entry, const bool batch)
+{
+	/* This is the same message nfq_set_verdict2() and nfq_set_verdict_batch2()
+		build, we put many of them in one buffer so that the kernel gets all
+		verdicts from this iteration in a single sendmsg() */
+	struct nlmsghdr *messageHeader			= (struct nlmsghdr *)&verdictBuffer[verdictBufferLength];
+	struct nfgenmsg *netfilterHeader		= (struct nfgenmsg *)NLMSG_DATA(messageHeader);
+	struct nlattr *attribute				= (struct nlattr *)((char *)netfilterHeader + NLMSG_ALIGN(sizeof(struct nfgenmsg)));
+	struct nfqnl_msg_verdict_hdr *verdictHeader;
+
+	messageHeader->nlmsg_type				= (NFNL_SUBSYS_QUEUE << 8) | (batch ? NFQNL_MSG_VERDICT_BATCH : NFQNL_MSG_VERDICT);
+	messageHeader->nlmsg_flags				= NLM_F_REQUEST;
+	messageHeader->nlmsg_seq				= ++verdictSequence;
+	messageHeader->nlmsg_pid				= 0;
+
+	netfilterHeader->nfgen_family			= AF_UNSPEC;
+	netfilterHeader->version				= NFNETLINK_V0;
+	netfilterHeader->res_id					= htons(queue);
+
+	attribute->nla_type						= NFQA_VERDICT_HDR;
+	attribute->nla_len						= NLA_HDRLEN + sizeof(struct nfqnl_msg_verdict_hdr);
+	verdictHeader							= (struct nfqnl_msg_verdict_hdr *)((char *)attribute + NLA_HDRLEN);
+	verdictHeader->verdict					= htonl(entry.verdict);
+	verdictHeader->id						= htonl(entry.packetId);
+	attribute								= (struct nlattr *)((char *)attribute + NLA_ALIGN(attribute->nla_len));
+
+	if(entry.mark >= 0)
+	{
+		attribute->nla_type					= NFQA_MARK;
+		attribute->nla_len					= NLA_HDRLEN + sizeof(u_int32_t);
+		*(u_int32_t *)((char *)attribute + NLA_HDRLEN) = htonl(entry.mark);
+		attribute							= (struct nlattr *)((char *)attribute + NLA_ALIGN(attribute->nla_len));
 	}
 
-	if(verdict == NetherVerdict::deny)
+	/* Write the decision into the conntrack mark, the rules restore it for
+		the following packets of this connection so they never get queued.
+		Allowed connections without a mark get the "allow" mark, so that
+		they can be told apart from undecided ones */
+	if(!batch && netherConfig.connmarkVerdicts)
 	{
-		ret = nfq_set_verdict2(queueHandle,
-								packetId,
-								NF_ACCEPT,
-								/* if we're relaxed, let's not stress out */
-								/* if we get a mark from the verdict caster */
-								/* let's use it, maybe it knows better */
-								mark > 0 ? mark : (netherConfig.relaxed ? netherConfig.markAllowAndLog : netherConfig.markDeny),
-								0,
-								NULL);
+		struct nlattr *conntrackAttribute	= attribute;
+
+		conntrackAttribute->nla_type		= NFQA_CT | NLA_F_NESTED;
+		attribute							= (struct nlattr *)((char *)conntrackAttribute + NLA_HDRLEN);
+		attribute->nla_type					= NETHER_CTA_MARK;
+		attribute->nla_len					= NLA_HDRLEN + sizeof(u_int32_t);
+		*(u_int32_t *)((char *)attribute + NLA_HDRLEN) = htonl(entry.mark >= 0 ? entry.mark : netherConfig.markAllow);
+		attribute							= (struct nlattr *)((char *)attribute + NLA_ALIGN(attribute->nla_len));
+		conntrackAttribute->nla_len			= (char *)attribute - (char *)conntrackAttribute;
 	}
 
-	if(verdict == NetherVerdict::allowAndLog)
-		ret = nfq_set_verdict2(queueHandle, packetId, NF_ACCEPT, netherConfig.markAllowAndLog, 0, NULL);
+	messageHeader->nlmsg_len				= (char *)attribute - (char *)messageHeader;
+	verdictBufferLength						+= NLMSG_ALIGN(messageHeader->nlmsg_len);
+}
 
-	if(ret == -1)
-		LOGW("can't set verdict for packetId=" << packetId);
+void NetherNetlink::sendVerdictMessages(const size_t firstEntry, const size_t lastEntry)
+{
+	struct sockaddr_nl kernelAddress;
+	struct iovec verdictVector;
+	struct msghdr verdictMessage;
+
+	if(verdictBufferLength == 0)
+		return;
+
+	memset(&kernelAddress, 0, sizeof(kernelAddress));
+	kernelAddress.nl_family			= AF_NETLINK;
+
+	verdictVector.iov_base			= &verdictBuffer[0];
+	verdictVector.iov_len			= verdictBufferLength;
+
+	memset(&verdictMessage, 0, sizeof(verdictMessage));
+	verdictMessage.msg_name			= &kernelAddress;
+	verdictMessage.msg_namelen		= sizeof(kernelAddress);
+	verdictMessage.msg_iov			= &verdictVector;
+	verdictMessage.msg_iovlen		= 1;
+
+	verdictBufferLength = 0;
+
+	if(sendmsg(nfq_fd(nfqHandle), &verdictMessage, 0) < 0)
+	{
+		/* we can't leave those packets in the queue, try them one by one
+			(without the conntrack mark, the next packet will be queued again) */
+		LOGW_RATELIMITED("sendmsg() for " << lastEntry - firstEntry << " verdicts failed: " << strerror(errno));
+
+		for(size_t entry = firstEntry; entry < lastEntry; entry++)
+			issueVerdict(pendingVerdicts[entry]);
+
+		return;
+	}
+
+	verdictsIssued += lastEntry - firstEntry;
+	verdictSyscalls++;
+}
+
+uint64_t NetherNetlink::getVerdictsIssued() const
+{
+	return (verdictsIssued);
+}
+
+uint64_t NetherNetlink::getVerdictSyscalls() const
+{
+	return (verdictSyscalls);
+}
+
+uint64_t NetherNetlink::getVerdictSyscallsSaved() const
+{
+	return (verdictsIssued - verdictSyscalls);
 }
 
 bool NetherNetlink::reload()
@@ -232,3 +731,8 @@ const NetherConfig &NetherNetlink::getNetherConfig()
 {
 	return (netherConfig);
 }
+
+void NetherNetlink::setMetrics(NetherMetrics *metricsToSet)
+{
+	metrics = metricsToSet;
+}
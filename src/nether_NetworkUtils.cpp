@@ -28,109 +28,144 @@
 #define IP_PROTOCOL_TCP         (0x06)
 #define IP_PROTOCOL_ICMP        (0x01)
 #define IP_PROTOCOL_IGMP        (0x02)
+#define IP_PROTOCOL_IPV6_HOPOPTS (0x00)
 #define IP_PROTOCOL_IPV6_ROUTE  (0x2b)
 #define IP_PROTOCOL_IPV6_FRAG   (0x2c)
+#define IP_PROTOCOL_IPV6_AH     (0x33)
 #define IP_PROTOCOL_IPV6_ICMP   (0x3a)
 #define IP_PROTOCOL_IPV6_NONXT  (0x3b)
 #define IP_PROTOCOL_IPV6_OPTS   (0x3c)
 
-void decodePacket(NetherPacket &packet, unsigned char *payload)
+/* The kernel copies at most NETHER_COPY_RANGE bytes of a packet, every
+	decoder gets the length of what's there and reads nothing past it */
+void decodePacket(NetherPacket &packet, const unsigned char *payload, const int payloadLength)
 {
-	uint8_t ipVersion = (payload[0] >> 4) & 0x0F;
+	packet.transportType    = NetherTransportType::unknownTransportType;
+	packet.protocolType     = NetherProtocolType::unknownProtocolType;
 
-	switch(ipVersion)
+	if(payloadLength < 1)
+		return;
+
+	switch((payload[0] >> 4) & 0x0F)
 	{
 		case 4:
-			packet.protocolType     = NetherProtocolType::IPv4;
-			decodeIPv4Packet(packet, payload);
+			decodeIPv4Packet(packet, payload, payloadLength);
 			break;
 		case 6:
-			packet.protocolType     = NetherProtocolType::IPv6;
-			decodeIPv6Packet(packet, payload);
+			decodeIPv6Packet(packet, payload, payloadLength);
 			break;
 		default:
-			packet.transportType    = NetherTransportType::unknownTransportType;
-			packet.protocolType     = NetherProtocolType::unknownProtocolType;
 			break;
 	}
 }
 
-void decodeIPv6Packet(NetherPacket &packet, unsigned char *payload)
+void decodeIPv6Packet(NetherPacket &packet, const unsigned char *payload, const int payloadLength)
 {
-	const uint16_t startOfIpPayload = 40;
+	int startOfIpPayload = NETHER_IPV6_HEADER_SIZE;
+	bool firstFragment = true;
 	uint8_t nextProto;
 
+	if(payloadLength < NETHER_IPV6_HEADER_SIZE)
+		return;
+
+	packet.protocolType = NetherProtocolType::IPv6;
+
 	memcpy(packet.localAddress, &payload[8], NETHER_NETWORK_IPV6_ADDR_LEN);
 	memcpy(packet.remoteAddress, &payload[24], NETHER_NETWORK_IPV6_ADDR_LEN);
 
 	nextProto = payload[6];
 
-	switch(nextProto)
+	/* walk the extension headers to the transport header, every one of
+		them starts with the next header and it's length */
+	while(nextProto == IP_PROTOCOL_IPV6_HOPOPTS || nextProto == IP_PROTOCOL_IPV6_ROUTE ||
+			nextProto == IP_PROTOCOL_IPV6_OPTS || nextProto == IP_PROTOCOL_IPV6_FRAG || nextProto == IP_PROTOCOL_IPV6_AH)
 	{
-		case IPPROTO_UDP:
-			packet.transportType = NetherTransportType::UDP;
-			decodeUdp(packet, &payload[startOfIpPayload]);
-			break;
-		case IPPROTO_TCP:
-			packet.transportType = NetherTransportType::TCP;
-			decodeTcp(packet, &payload[startOfIpPayload]);
-			break;
-		case IPPROTO_ICMP:
-			packet.transportType = NetherTransportType::ICMP;
-			break;
-		case IPPROTO_IGMP:
-			packet.transportType = NetherTransportType::IGMP;
-			break;
-		default:
-			packet.transportType = NetherTransportType::unknownTransportType;
-			break;
+		if(startOfIpPayload + 8 > payloadLength)
+			return;
+
+		switch(nextProto)
+		{
+			case IP_PROTOCOL_IPV6_FRAG:
+				/* only the first fragment has the transport header */
+				firstFragment = ((payload[startOfIpPayload + 2] << 8 | payload[startOfIpPayload + 3]) & 0xfff8) == 0;
+				nextProto = payload[startOfIpPayload];
+				startOfIpPayload += 8;
+				break;
+			case IP_PROTOCOL_IPV6_AH:
+				nextProto = payload[startOfIpPayload];
+				startOfIpPayload += (payload[startOfIpPayload + 1] + 2) << 2;
+				break;
+			default:
+				nextProto = payload[startOfIpPayload];
+				startOfIpPayload += (payload[startOfIpPayload + 1] + 1) << 3;
+				break;
+		}
 	}
+
+	if(nextProto == IP_PROTOCOL_IPV6_NONXT || startOfIpPayload > payloadLength)
+		return;
+
+	decodeTransport(packet, nextProto, &payload[startOfIpPayload], firstFragment ? payloadLength - startOfIpPayload : 0);
 }
 
-void decodeIPv4Packet(NetherPacket &packet, unsigned char *payload)
+void decodeIPv4Packet(NetherPacket &packet, const unsigned char *payload, const int payloadLength)
 {
-	uint16_t startOfIpPayload = 0;
-	uint8_t nextProto;
+	const int startOfIpPayload = (payload[0]&0x0F) << 2;
+
+	if(payloadLength < NETHER_IPV4_HEADER_SIZE || startOfIpPayload < NETHER_IPV4_HEADER_SIZE || startOfIpPayload > payloadLength)
+		return;
 
-	startOfIpPayload = (payload[0]&0x0F) << 2;
+	packet.protocolType = NetherProtocolType::IPv4;
 
 	memcpy(packet.localAddress, &payload[12], NETHER_NETWORK_IPV4_ADDR_LEN);
 	memcpy(packet.remoteAddress, &payload[16], NETHER_NETWORK_IPV4_ADDR_LEN);
 
-	nextProto = payload[9];
+	/* only the first fragment (offset 0) has the transport header */
+	decodeTransport(packet, payload[9], &payload[startOfIpPayload],
+					((payload[6] << 8 | payload[7]) & 0x1fff) == 0 ? payloadLength - startOfIpPayload : 0);
+}
 
-	switch(nextProto)
+void decodeTransport(NetherPacket &packet, const uint8_t protocol, const unsigned char *payload, const int payloadLength)
+{
+	switch(protocol)
 	{
 		case IPPROTO_UDP:
 			packet.transportType = NetherTransportType::UDP;
-			decodeUdp(packet, &payload[startOfIpPayload]);
+			decodeUdp(packet, payload, payloadLength);
 			break;
 		case IPPROTO_TCP:
 			packet.transportType = NetherTransportType::TCP;
-			decodeTcp(packet, &payload[startOfIpPayload]);
+			decodeTcp(packet, payload, payloadLength);
 			break;
 		case IPPROTO_ICMP:
+		case IP_PROTOCOL_IPV6_ICMP:
 			packet.transportType = NetherTransportType::ICMP;
 			break;
 		case IPPROTO_IGMP:
 			packet.transportType = NetherTransportType::IGMP;
+			break;
 		default:
 			packet.transportType = NetherTransportType::unknownTransportType;
 			break;
 	}
 }
 
-void decodeTcp(NetherPacket &packet, unsigned char *payload)
+void decodeTcp(NetherPacket &packet, const unsigned char *payload, const int payloadLength)
 {
-	packet.localPort = ntohs(*(unsigned short*) &payload[0]);
-	packet.remotePort = ntohs(*(unsigned short*) &payload[2]);
+	if(payloadLength < NETHER_PORTS_SIZE)
+		return;
+
+	packet.localPort = payload[0] << 8 | payload[1];
+	packet.remotePort = payload[2] << 8 | payload[3];
 }
 
-void decodeUdp(NetherPacket &packet, unsigned char *payload)
+void decodeUdp(NetherPacket &packet, const unsigned char *payload, const int payloadLength)
 {
-	packet.localPort = ntohs(*(unsigned short*) &payload[0]);
-	packet.remotePort = ntohs(*(unsigned short*) &payload[2]);
+	if(payloadLength < NETHER_PORTS_SIZE)
+		return;
 
+	packet.localPort = payload[0] << 8 | payload[1];
+	packet.remotePort = payload[2] << 8 | payload[3];
 }
 
 std::string ipAddressToString(const char *src, enum NetherProtocolType type)
@@ -151,7 +151,7 @@ std::string packetToString(const NetherPacket &packet)
 	stream << "ID=";
 	stream << packet.id;
 	stream << " SECCTX=";
-	stream << packet.securityContext;
+	stream << NetherLabelTable::toString(packet.securityContext);
 	stream << " OUTDEV=";
 	stream << packet.outdevName;
 	stream << " UID=";
@@ -189,3 +189,54 @@ std::vector<std::string> tokenize(const std::string &str, const std::string &del
         v.emplace_back(str, start, str.length() - start); // add what's left of the string
     return v;
 }
+
+bool parseQueueNumbers(const std::string &queuesAsString, std::vector<int> &queueNumbers)
+{
+	/* accepts lists like "0-7" or "0,2,4-6" */
+	for(auto &range : tokenize(queuesAsString, ","))
+	{
+		std::vector<std::string> bounds = tokenize(range, "-");
+		char *end;
+		long first, last;
+
+		if(bounds.size() < 1 || bounds.size() > 2)
+			return (false);
+
+		first	= strtol(bounds[0].c_str(), &end, 10);
+		if(*end != '\0')
+			return (false);
+
+		last	= bounds.size() == 2 ? strtol(bounds[1].c_str(), &end, 10) : first;
+		if(*end != '\0')
+			return (false);
+
+		if(first < 0 || last >= 65535 || first > last)
+			return (false);
+
+		for(long queueNumber = first; queueNumber <= last; queueNumber++)
+			queueNumbers.push_back(queueNumber);
+	}
+
+	return (!queueNumbers.empty());
+}
+
+/* FNV-1a, chain calls through seed to cover several pieces of data */
+uint64_t fingerprint(const void *data, const size_t length, const uint64_t seed)
+{
+	const uint8_t *bytes	= (const uint8_t *)data;
+	uint64_t hash			= seed;
+
+	for(size_t n = 0; n < length; n++)
+	{
+		hash ^= bytes[n];
+		hash *= 1099511628211ULL;
+	}
+
+	return (hash);
+}
+
+uint64_t fingerprint(const std::string &str, const uint64_t seed)
+{
+	/* the terminating zero keeps "ab","c" and "a","bc" apart */
+	return (fingerprint(str.c_str(), str.length() + 1, seed));
+}
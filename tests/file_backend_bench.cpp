@@ -0,0 +1,167 @@
+/*
+ *  Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Roman Kubiak (r.kubiak@samsung.com)
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+
+/**
+ * @file
+ * @author  Roman Kubiak (r.kubiak@samsung.com)
+ * @brief   FILE policy backend lookup benchmark
+ *
+ * Generates policies of growing size (one entry per application label,
+ * some with a wildcard gid, plus entries without a label) and measures
+ * the time to decide on a packet.
+ * Every decision is also checked against a linear first-match scan.
+ */
+
+#include "nether_FileBackend.h"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+#define BENCH_LOOKUPS		1000000
+#define BENCH_POLICY_PATH	"/tmp/nether_bench.policy"
+
+class BenchVerdictListener : public NetherVerdictListener
+{
+	public:
+		bool verdictCast(const u_int32_t, const NetherVerdict verdict, int, const NetherVerdictPath)
+		{
+			lastVerdict = verdict;
+			return (true);
+		}
+		NetherVerdict lastVerdict;
+};
+
+static NetherVerdict linearLookup(const std::vector<PolicyEntry> &policy, const NetherPacket &packet, const NetherVerdict defaultVerdict)
+{
+	for(auto &entry : policy)
+	{
+		if(((entry.uid == packet.uid) || entry.uid == NETHER_INVALID_UID) &&
+				((entry.gid == packet.gid) || entry.gid == NETHER_INVALID_GID) &&
+				((entry.securityContext == NetherLabelTable::toString(packet.securityContext)) || entry.securityContext.empty()))
+			return (entry.verdict);
+	}
+
+	return (defaultVerdict);
+}
+
+static const char *verdictName(const int n)
+{
+	static const char *names[] = { "ALLOW", "DENY", "ALLOW_LOG" };
+	return (names[n % 3]);
+}
+
+static bool writePolicy(const int entries, std::vector<PolicyEntry> &policy)
+{
+	FILE *fp = fopen(BENCH_POLICY_PATH, "w");
+
+	if(fp == NULL)
+	{
+		perror(BENCH_POLICY_PATH);
+		return (false);
+	}
+
+	policy.clear();
+
+	for(int n = 0; n < entries; n++)
+	{
+		/* every 7th entry has a wildcard gid, lines with a wildcard
+			uid (starting with the delimiter) are skipped by the parser */
+		const bool anyGid = (n % 7) == 6;
+		const std::string label = "app" + std::to_string(n);
+
+		fprintf(fp, "%d:%s:%s:%s\n", 5000 + n, anyGid ? "" : std::to_string(100 + n % 5).c_str(), label.c_str(), verdictName(n));
+
+		policy.push_back(PolicyEntry{(uid_t)(5000 + n),
+									 anyGid ? NETHER_INVALID_GID : (gid_t)(100 + n % 5),
+									 label,
+									 stringToVerdict((char *)verdictName(n))});
+	}
+
+	/* entries without a label, these match every application */
+	fprintf(fp, "0:::ALLOW\n");
+	fprintf(fp, "5001:100::DENY\n");
+	policy.push_back(PolicyEntry{0, NETHER_INVALID_GID, "", NetherVerdict::allow});
+	policy.push_back(PolicyEntry{5001, 100, "", NetherVerdict::deny});
+
+	fclose(fp);
+	return (true);
+}
+
+int main()
+{
+	const int sizes[] = { 10, 100, 1000, 10000, 100000 };
+	std::mt19937 generator(1);
+
+	for(auto size : sizes)
+	{
+		NetherConfig config;
+		std::vector<PolicyEntry> expectedPolicy;
+		std::vector<NetherPacket> packets(1024);
+		BenchVerdictListener listener;
+
+		config.backupBackendArgs	= BENCH_POLICY_PATH;
+		config.defaultVerdict		= NetherVerdict::allowAndLog;
+
+		if(!writePolicy(size, expectedPolicy))
+			return (1);
+
+		NetherFileBackend backend(config);
+		backend.setListener(&listener);
+
+		if(!backend.initialize())
+		{
+			fprintf(stderr, "failed to load %s\n", BENCH_POLICY_PATH);
+			return (1);
+		}
+
+		/* a mix of matching, partially matching and unknown packets */
+		for(auto &packet : packets)
+		{
+			const int n		= generator() % (size * 2);
+			packet.id				= n;
+			packet.uid				= (generator() % 4) ? 5000 + n : 5000 + generator() % 3;
+			packet.gid				= 100 + generator() % 6;
+			packet.securityContext	= NetherLabelTable::intern("app" + std::to_string(n));
+		}
+
+		for(auto &packet : packets)
+		{
+			backend.enqueueVerdict(packet);
+
+			if(listener.lastVerdict != linearLookup(expectedPolicy, packet, config.defaultVerdict))
+			{
+				fprintf(stderr, "wrong verdict for uid=%d gid=%d label=%s\n",
+						packet.uid, packet.gid, NetherLabelTable::toString(packet.securityContext).c_str());
+				return (1);
+			}
+		}
+
+		auto start = std::chrono::steady_clock::now();
+
+		for(int n = 0; n < BENCH_LOOKUPS; n++)
+			backend.enqueueVerdict(packets[n % packets.size()]);
+
+		auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+
+		printf("entries=%-8d lookups=%d ns/lookup=%.1f\n", size, BENCH_LOOKUPS, (double)elapsed.count() / BENCH_LOOKUPS);
+	}
+
+	unlink(BENCH_POLICY_PATH);
+	return (0);
+}
@@ -0,0 +1,109 @@
+/*
+ *  Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Roman Kubiak (r.kubiak@samsung.com)
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+
+/**
+ * @file
+ * @author  Roman Kubiak (r.kubiak@samsung.com)
+ * @brief   Cost and accuracy of the packet latency histograms
+ *
+ * Checks the bucket limits, compares the percentiles of the histogram with
+ * the exact ones of the same latencies and measures what recording a packet
+ * (receive and verdict) and reading the percentiles costs.
+ */
+
+#include "nether_LatencyHistogram.h"
+#include "nether_Utils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+#define TEST_PACKETS	10000000
+#define TEST_LATENCIES	1000000
+
+static double elapsedNanoseconds(const std::chrono::steady_clock::time_point &start)
+{
+	return (std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count());
+}
+
+int main()
+{
+	std::mt19937_64 random(1);
+	std::lognormal_distribution<double> latencyDistribution(10.0, 1.5); /* around 20us with a long tail */
+	std::vector<uint64_t> latencies;
+	NetherLatencyHistogram histogram;
+	NetherPacketLatency packetLatency;
+	uint64_t checksum = 0;
+
+	for(uint32_t bucket = 0; bucket < NETHER_HISTOGRAM_BUCKETS; bucket++)
+	{
+		if(NetherLatencyHistogram::getBucket(NetherLatencyHistogram::getBucketLimit(bucket)) != bucket ||
+				(bucket > 0 && NetherLatencyHistogram::getBucket(NetherLatencyHistogram::getBucketLimit(bucket - 1) + 1) != bucket))
+		{
+			printf("bucket %u limits are wrong\n", bucket);
+			return (1);
+		}
+	}
+
+	for(unsigned int n = 0; n < TEST_LATENCIES; n++)
+	{
+		latencies.push_back((uint64_t)latencyDistribution(random));
+		histogram.record(latencies.back());
+	}
+
+	std::sort(latencies.begin(), latencies.end());
+
+	for(double percentile : {50.0, 90.0, 99.0, 99.9})
+	{
+		const uint64_t exact		= latencies[(size_t)(latencies.size() * percentile / 100.0 + 0.5) - 1];
+		const uint64_t estimated	= histogram.getPercentile(percentile);
+		const double error			= (double)estimated / exact - 1.0;
+
+		printf("p%-5.1f exact %10lu ns histogram %10lu ns error %+5.1f%%\n", percentile, exact, estimated, error * 100);
+
+		if(error < 0 || error > 1.0 / NETHER_HISTOGRAM_SUB_BUCKETS)
+			return (1);
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	for(u_int32_t packetId = 0; packetId < TEST_PACKETS; packetId++)
+	{
+		/* a few packets always wait for the backend */
+		packetLatency.packetReceived(packetId, packetId * 1000, NetherLatencySource::cynara);
+		if(packetId >= 64)
+			packetLatency.packetDecided(packetId - 64, NetherVerdict::allow, NetherVerdictPath::cached, packetId * 1000 + (packetId & 0xfff));
+	}
+	printf("%-36s %6.1f ns/packet\n", "receive and verdict", elapsedNanoseconds(start) / TEST_PACKETS);
+
+	start = std::chrono::steady_clock::now();
+	for(unsigned int n = 0; n < TEST_PACKETS; n++)
+		checksum += monotonicTime();
+	printf("%-36s %6.1f ns/call\n", "monotonicTime()", elapsedNanoseconds(start) / TEST_PACKETS);
+
+	start = std::chrono::steady_clock::now();
+	for(unsigned int n = 0; n < 10000; n++)
+		checksum += histogram.getPercentile(99.9);
+	printf("%-36s %6.1f ns/call\n", "getPercentile()", elapsedNanoseconds(start) / 10000);
+
+	printf("packets=%lu untracked=%lu (%lu)\n",
+		   packetLatency.getHistogram(NetherLatencySource::cynaraCache, NetherVerdict::allow).getCount(),
+		   packetLatency.getUntracked(), checksum & 0xff);
+
+	return (0);
+}
@@ -0,0 +1,103 @@
+/*
+ *  Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Roman Kubiak (r.kubiak@samsung.com)
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+
+/**
+ * @file
+ * @author  Roman Kubiak (r.kubiak@samsung.com)
+ * @brief   Lines per second of the log file backend
+ *
+ * Compares the buffered logger::FileBackend with the way it used to work
+ * (open, write and close the file for every line), with and without the
+ * asynchronous backend in front of it, and checks that no line is lost.
+ */
+
+#include "logger/formatter.hpp"
+#include "logger/backend-file.hpp"
+#include "logger/backend-async.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <string>
+
+#define TEST_LINES		200000
+#define TEST_LOG_PATH	"/tmp/nether_log_bench.log"
+
+/* what logger::FileBackend::log() did before it kept the file open */
+class OpenPerLineBackend : public logger::LogBackend
+{
+	public:
+		void log(logger::LogLevel logLevel,
+				 const std::string& file,
+				 const unsigned int& line,
+				 const std::string& func,
+				 const std::string& message) override
+		{
+			std::ofstream out(TEST_LOG_PATH, std::ios::app);
+			out << logger::LogFormatter::getHeader(logLevel, file, line, func);
+			out << message;
+			out << std::endl;
+		}
+};
+
+static size_t countLines(const char *path)
+{
+	std::ifstream in(path);
+	std::string line;
+	size_t lines = 0;
+
+	while(std::getline(in, line))
+		lines++;
+
+	return (lines);
+}
+
+static bool runBenchmark(const char *name, const std::function<logger::LogBackend *()> &createBackend)
+{
+	const std::string message = "packet id=12345 uid=5000 gid=100 secctx=User::App::org.example.app proto=TCP";
+	size_t lines;
+
+	remove(TEST_LOG_PATH);
+
+	const auto start = std::chrono::steady_clock::now();
+	{
+		std::unique_ptr<logger::LogBackend> backend(createBackend());
+
+		for(unsigned int n = 0; n < TEST_LINES; n++)
+			backend->log(logger::LogLevel::INFO, "src/nether_Manager.cpp", 42, "packetReceived", message);
+	}
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	lines = countLines(TEST_LOG_PATH);
+	printf("%-24s %10.0f lines/s %s\n", name, TEST_LINES / seconds, lines == TEST_LINES ? "" : "LINES LOST");
+	return (lines == TEST_LINES);
+}
+
+int main()
+{
+	bool passed = true;
+
+	passed &= runBenchmark("open per line", []() { return (new OpenPerLineBackend()); });
+	passed &= runBenchmark("buffered", []() { return (new logger::FileBackend(TEST_LOG_PATH)); });
+	passed &= runBenchmark("buffered, async", []() {
+		return (new logger::AsyncBackend(new logger::FileBackend(TEST_LOG_PATH), 4096, logger::OverflowPolicy::BLOCK)); });
+
+	remove(TEST_LOG_PATH);
+	return (passed ? 0 : 1);
+}
@@ -0,0 +1,97 @@
+/*
+ *  Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Roman Kubiak (r.kubiak@samsung.com)
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+
+/**
+ * @file
+ * @author  Roman Kubiak (r.kubiak@samsung.com)
+ * @brief   Nanoseconds per log header
+ *
+ * Compares LogFormatter::formatHeader() and getHeader() with the way the
+ * header used to be built (gettimeofday() and localtime() for every header,
+ * an ostringstream with setw()), and checks that they produce the same text.
+ */
+
+#include "logger/formatter.hpp"
+#include "logger/level.hpp"
+
+#include <sys/time.h>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+#define TEST_HEADERS	1000000
+
+static const std::string testFile = "src/nether_Manager.cpp";
+static const std::string testFunc = "packetReceived";
+
+/* LogFormatter::getHeader() before it was rewritten */
+static std::string oldGetHeader(logger::LogLevel logLevel, const std::string& file, const unsigned int& line, const std::string& func)
+{
+	char time[13];
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	struct tm* tm = localtime(&tv.tv_sec);
+	snprintf(time, sizeof(time), "%02d:%02d:%02d.%03d", tm->tm_hour, tm->tm_min, tm->tm_sec, int(tv.tv_usec / 1000));
+
+	std::ostringstream logLine;
+	logLine << std::string(time) << ' '
+			<< std::left << std::setw(8) << '[' + logger::toString(logLevel) + ']'
+			<< std::right << std::setw(3) << logger::LogFormatter::getCurrentThread() << ": "
+			<< std::left << std::setw(60)
+			<< file + ':' + std::to_string(line) + ' ' + func + ':';
+	return logLine.str();
+}
+
+static void runBenchmark(const char *name, const std::function<size_t()> &formatOne)
+{
+	size_t checksum = 0;
+
+	const auto start = std::chrono::steady_clock::now();
+	for(unsigned int n = 0; n < TEST_HEADERS; n++)
+		checksum += formatOne();
+	const double nanoseconds = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+	printf("%-32s %8.1f ns/header (%zu)\n", name, nanoseconds / TEST_HEADERS, checksum / TEST_HEADERS);
+}
+
+int main()
+{
+	char header[logger::LOG_HEADER_LENGTH];
+	std::string oldHeader, newHeader;
+
+	/* the time part changes between calls, compare the rest */
+	oldHeader = oldGetHeader(logger::LogLevel::WARN, testFile, 1234, testFunc);
+	newHeader = logger::LogFormatter::getHeader(logger::LogLevel::WARN, testFile, 1234, testFunc);
+
+	if(oldHeader.size() != newHeader.size() || oldHeader.compare(12, std::string::npos, newHeader, 12, std::string::npos) != 0)
+	{
+		printf("headers differ:\n\"%s\"\n\"%s\"\n", oldHeader.c_str(), newHeader.c_str());
+		return (1);
+	}
+
+	runBenchmark("ostringstream, localtime()", []() { return (oldGetHeader(logger::LogLevel::INFO, testFile, 1234, testFunc).size()); });
+	runBenchmark("LogFormatter::getHeader()", []() { return (logger::LogFormatter::getHeader(logger::LogLevel::INFO, testFile, 1234, testFunc).size()); });
+	runBenchmark("LogFormatter::formatHeader()", [&header]() {
+		return (logger::LogFormatter::formatHeader(header, sizeof(header), logger::LogLevel::INFO, testFile, 1234, testFunc)); });
+
+	return (0);
+}
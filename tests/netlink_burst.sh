@@ -0,0 +1,48 @@
+#!/bin/bash
+
+# Sends a burst of UDP packets to the discard port through a netfilter
+# queue and shows how many of them the kernel dropped. Run it as root
+# while nether is bound to the queue.
+
+if [ "$1" == "" ]; then
+	echo "$0 <queue number> [packets]"
+	exit 1
+fi
+
+QUEUE=$1
+PACKETS=${2:-100000}
+PORT=9
+STATS=/proc/net/netfilter/nfnetlink_queue
+
+# queue_dropped and user_dropped of the queue
+function queue_drops {
+	awk -v queue=$QUEUE '$1 == queue { print $6, $7 }' $STATS
+}
+
+if [ "$(queue_drops)" == "" ]; then
+	echo "Nothing is bound to queue $QUEUE"
+	exit 1
+fi
+
+iptables -I OUTPUT -o lo -p udp --dport $PORT -j NFQUEUE --queue-num $QUEUE
+read queueDroppedBefore userDroppedBefore <<< "$(queue_drops)"
+
+echo "Sending $PACKETS packets"
+python3 -c "
+import socket
+s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+for n in range($PACKETS):
+	s.sendto(b'nether', ('127.0.0.1', $PORT))
+"
+
+# give nether time to decide about the rest
+sleep 2
+
+read queueDropped userDropped <<< "$(queue_drops)"
+iptables -D OUTPUT -o lo -p udp --dport $PORT -j NFQUEUE --queue-num $QUEUE
+
+queueDropped=$((queueDropped - queueDroppedBefore))
+userDropped=$((userDropped - userDroppedBefore))
+
+echo "queue dropped: $queueDropped ($((queueDropped * 100 / PACKETS))%)"
+echo "user dropped: $userDropped ($((userDropped * 100 / PACKETS))%)"
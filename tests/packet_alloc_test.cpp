@@ -0,0 +1,283 @@
+/*
+ *  Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Roman Kubiak (r.kubiak@samsung.com)
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+
+/**
+ * @file
+ * @author  Roman Kubiak (r.kubiak@samsung.com)
+ * @brief   Count heap allocations on the per packet path
+ *
+ * Runs a queue manager (FILE primary backend) on top of the libnetfilter_queue
+ * functions below, every packet goes through NetherNetlink::callback(),
+ * NetherManager::packetReceived(), the backend, NetherManager::verdictCast()
+ * and nfq_set_verdict(). Fails if that allocates once all labels are known,
+ * without and with a decision cache that holds every decision. Decisions
+ * that are not in the cache yet are inserted into it, that allocates.
+ */
+
+#include "nether_Manager.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <sys/eventfd.h>
+
+#define TEST_LABELS		64
+#define TEST_PACKETS	100000
+#define TEST_POLICY_PATH	"/tmp/nether_alloc_test.policy"
+
+static unsigned long allocations = 0;
+
+void *operator new(size_t size)
+{
+	void *pointer = malloc(size ? size : 1);
+
+	if(pointer == NULL)
+		throw std::bad_alloc();
+
+	allocations++;
+	return (pointer);
+}
+
+void operator delete(void *pointer) noexcept
+{
+	free(pointer);
+}
+
+/* Just enough of libnetfilter_queue to hand packets to the callback
+	and count the verdicts, there is no kernel queue behind it */
+struct nfq_handle
+{
+	int descriptor;
+};
+
+struct nfq_q_handle
+{
+	nfq_callback *callback;
+	void *data;
+};
+
+struct nfq_data
+{
+	struct nfqnl_msg_packet_hdr header;
+	uint32_t uid;
+	uint32_t gid;
+	const char *secctx;
+};
+
+static struct nfq_handle testHandle;
+static struct nfq_q_handle testQueue;
+static unsigned long verdicts = 0;
+
+struct nfq_handle *nfq_open(void)
+{
+	testHandle.descriptor = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	return (testHandle.descriptor == -1 ? NULL : &testHandle);
+}
+
+int nfq_close(struct nfq_handle *h)
+{
+	return (close(h->descriptor));
+}
+
+int nfq_bind_pf(struct nfq_handle *, uint16_t)
+{
+	return (0);
+}
+
+int nfq_unbind_pf(struct nfq_handle *, uint16_t)
+{
+	return (0);
+}
+
+struct nfq_q_handle *nfq_create_queue(struct nfq_handle *, uint16_t, nfq_callback *cb, void *data)
+{
+	testQueue.callback	= cb;
+	testQueue.data		= data;
+	return (&testQueue);
+}
+
+int nfq_destroy_queue(struct nfq_q_handle *)
+{
+	return (0);
+}
+
+int nfq_handle_packet(struct nfq_handle *, char *, int)
+{
+	return (0);
+}
+
+int nfq_set_mode(struct nfq_q_handle *, uint8_t, uint32_t)
+{
+	return (0);
+}
+
+int nfq_set_queue_maxlen(struct nfq_q_handle *, uint32_t)
+{
+	return (0);
+}
+
+int nfq_set_queue_flags(struct nfq_q_handle *, uint32_t, uint32_t)
+{
+	return (0);
+}
+
+int nfq_set_verdict(struct nfq_q_handle *, uint32_t, uint32_t, uint32_t, const unsigned char *)
+{
+	verdicts++;
+	return (0);
+}
+
+int nfq_set_verdict2(struct nfq_q_handle *, uint32_t, uint32_t, uint32_t, uint32_t, const unsigned char *)
+{
+	verdicts++;
+	return (0);
+}
+
+int nfq_set_verdict_batch2(struct nfq_q_handle *, uint32_t, uint32_t, uint32_t)
+{
+	verdicts++;
+	return (0);
+}
+
+int nfq_fd(struct nfq_handle *h)
+{
+	return (h->descriptor);
+}
+
+struct nfqnl_msg_packet_hdr *nfq_get_msg_packet_hdr(struct nfq_data *nfad)
+{
+	return (&nfad->header);
+}
+
+uint32_t nfq_get_outdev(struct nfq_data *)
+{
+	return (0);
+}
+
+int nfq_get_outdev_name(struct nlif_handle *, struct nfq_data *, char *)
+{
+	return (-1);
+}
+
+int nfq_get_uid(struct nfq_data *nfad, uint32_t *uid)
+{
+	*uid = nfad->uid;
+	return (1);
+}
+
+int nfq_get_gid(struct nfq_data *nfad, uint32_t *gid)
+{
+	*gid = nfad->gid;
+	return (1);
+}
+
+int nfq_get_secctx(struct nfq_data *nfad, unsigned char **secdata)
+{
+	*secdata = (unsigned char *)nfad->secctx;
+	return (strlen(nfad->secctx));
+}
+
+int nfq_get_payload(struct nfq_data *, unsigned char **)
+{
+	return (-1);
+}
+
+struct nlif_handle *nlif_open(void)
+{
+	return (NULL);
+}
+
+int nlif_query(struct nlif_handle *)
+{
+	return (0);
+}
+
+static bool runPackets(const char *name, const size_t decisionCacheSize, char rawLabels[TEST_LABELS][64])
+{
+	NetherConfig config;
+
+	config.primaryBackendType	= NetherPolicyBackendType::fileBackend;
+	config.backupBackendType	= NetherPolicyBackendType::dummyBackend;
+	config.backupBackendArgs	= TEST_POLICY_PATH;
+	config.decisionCacheSize	= decisionCacheSize;
+
+	NetherManager manager(config, true);
+
+	if(!manager.initialize())
+	{
+		fprintf(stderr, "%s: failed to initialize the manager\n", name);
+		return (false);
+	}
+
+	for(int pass = 0; pass < 2; pass++)
+	{
+		const unsigned long allocationsBefore = allocations;
+		verdicts = 0;
+
+		for(int n = 0; n < TEST_PACKETS; n++)
+		{
+			struct nfq_data packet;
+
+			packet.header.packet_id	= htonl(n);
+			packet.uid				= 5000 + n % TEST_LABELS;
+			packet.gid				= 100;
+			packet.secctx			= rawLabels[n % TEST_LABELS];
+			testQueue.callback(&testQueue, NULL, &packet, testQueue.data);
+		}
+
+		/* the first pass fills the label table (and the decision cache) */
+		if(pass == 1)
+		{
+			printf("%s: packets=%d verdicts=%lu allocations=%lu (%.3f per packet)\n",
+				   name, TEST_PACKETS, verdicts, allocations - allocationsBefore,
+				   (double)(allocations - allocationsBefore) / TEST_PACKETS);
+
+			return (verdicts == TEST_PACKETS && allocations == allocationsBefore);
+		}
+	}
+
+	return (false);
+}
+
+int main()
+{
+	char rawLabels[TEST_LABELS][64];
+	FILE *fp = fopen(TEST_POLICY_PATH, "w");
+	bool passed;
+
+	if(fp == NULL)
+	{
+		perror(TEST_POLICY_PATH);
+		return (1);
+	}
+
+	/* long labels, well past the small string optimization */
+	for(int n = 0; n < TEST_LABELS; n++)
+	{
+		snprintf(rawLabels[n], sizeof(rawLabels[n]), "User_Pkg_org_example_application_number_%d", n);
+		fprintf(fp, "%d::%s:%s\n", 5000 + n, rawLabels[n], (n % 2) ? "ALLOW" : "DENY");
+	}
+
+	fclose(fp);
+
+	passed = runPackets("no decision cache", 0, rawLabels);
+	passed = runPackets("decision cache", TEST_LABELS, rawLabels) && passed;
+
+	unlink(TEST_POLICY_PATH);
+	return (passed ? 0 : 1);
+}
@@ -0,0 +1,62 @@
+/*
+ *  Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Roman Kubiak (r.kubiak@samsung.com)
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+
+/**
+ * @file
+ * @author  Roman Kubiak (r.kubiak@samsung.com)
+ * @brief   Check which decided packets can share a batch verdict
+ *
+ * A batch verdict releases every queued packet up to it's id, the run of
+ * decided packets given to it must stop before the first undecided one,
+ * also when the packet ids wrap around.
+ */
+
+#include "nether_Netlink.h"
+
+#include <cstdio>
+
+static int failures = 0;
+
+static void check(const char *name, const u_int32_t firstId, const u_int32_t lastId,
+				  const bool haveUndecided, const u_int32_t lowestUndecided, const size_t expectedLength)
+{
+	std::vector<NetherVerdictEntry> entries;
+
+	for(u_int32_t packetId = firstId; packetId != lastId + 1; packetId++)
+		entries.push_back(NetherVerdictEntry{packetId, NF_ACCEPT, -1});
+
+	const size_t length = NetherNetlink::getBatchEnd(entries, 0, entries.size(), haveUndecided, lowestUndecided);
+
+	printf("%-40s batch of %zu, expected %zu %s\n", name, length, expectedLength, length == expectedLength ? "OK" : "FAILED");
+
+	if(length != expectedLength)
+		failures++;
+}
+
+int main()
+{
+	check("nothing undecided", 3, 10, false, 0, 8);
+	check("undecided after the run", 3, 10, true, 20, 8);
+	check("undecided inside the run", 3, 10, true, 6, 3);
+	check("undecided before the run", 3, 10, true, 2, 1);
+	check("undecided before a wrap", 3, 10, true, 0xFFFFFFF8, 1);
+	check("run before a wrap, undecided after it", 0xFFFFFFF0, 0xFFFFFFF8, true, 2, 9);
+	check("undecided is the highest id", 3, 10, true, 0xFFFFFFFF, 1);
+
+	return (failures ? 1 : 0);
+}